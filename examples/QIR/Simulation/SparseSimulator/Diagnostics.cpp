@@ -0,0 +1,64 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "SparseSimulator.hpp"
+
+using namespace Microsoft::Quantum;
+
+
+///
+/// State inspection
+///
+
+void SparseSimulator::GetState(TGetStateCallback callback)
+{
+    // Only the stored basis states are listed, in increasing order. All others have amplitude zero.
+    std::vector<std::pair<uint64_t, Amplitude>> amps;
+    this->state.ForEach([&](uint64_t index, Amplitude& amp) { amps.push_back({index, amp}); });
+    std::sort(amps.begin(), amps.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (const auto& [index, amp] : amps)
+        if (!callback(index, amp.real(), amp.imag()))
+            break;
+}
+
+void SparseSimulator::DumpMachine(const void* location)
+{
+    // The state is always printed to the console, regardless of the location provided.
+    // Bit b of each basis state index is the qubit with ID b.
+    std::cout << "# wave function (non-zero amplitudes only):\n";
+    GetState([](size_t index, double re, double im) {
+        std::cout << "|" << index << "⟩:\t" << re << (im < 0 ? " - " : " + ") << std::abs(im) << "i\n";
+        return true;
+    });
+    std::cout << std::flush;
+}
+
+void SparseSimulator::DumpRegister(const void* location, const QirArray* qubits)
+{
+    throw std::logic_error("operation_not_supported");
+}
+
+
+///
+/// Assertions
+///
+
+bool SparseSimulator::Assert(long numTargets, PauliId* bases, Qubit* targets, Result result, const char* failureMessage)
+{
+    double probabilityOfZero = (result == UseZero()) ? 1.0 : 0.0;
+    return AssertProbability(numTargets, bases, targets, probabilityOfZero, 1e-10, failureMessage);
+}
+
+bool SparseSimulator::AssertProbability(long numTargets, PauliId bases[], Qubit targets[], double probabilityOfZero, double precision, const char* failureMessage)
+{
+    // Measuring P gives Zero with probability (1 + ⟨Ψ|P|Ψ⟩) / 2.
+    double actualProbabilityOfZero = (1.0 + Expectation(numTargets, bases, targets)) / 2.0;
+    return std::abs(actualProbabilityOfZero - probabilityOfZero) < precision;
+}
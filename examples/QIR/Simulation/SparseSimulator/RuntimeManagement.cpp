@@ -0,0 +1,83 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "SparseSimulator.hpp"
+
+using namespace Microsoft::Quantum;
+
+
+///
+/// Qubit management
+///
+
+Qubit SparseSimulator::AllocateQubit()
+{
+    Qubit q = this->qbm->Allocate();
+    // The top bit of the index is reserved for marking empty slots of the hash map.
+    if (this->qbm->GetQubitId(q) >= 63) {
+        this->qbm->Release(q);
+        throw std::logic_error("qubit_limit_exceeded");
+    }
+    return q;
+}
+
+void SparseSimulator::ReleaseQubit(Qubit q)
+{
+    // Reset the qubit to |0⟩, so that its bit is zero in all basis states when the ID is reused.
+    PauliId z = PauliId_Z;
+    if (Measure(1, &z, 1, &q) == UseOne())
+        X(q);
+    this->qbm->Release(q);
+}
+
+std::string SparseSimulator::QubitToString(Qubit q)
+{
+    return std::to_string(this->qbm->GetQubitId(q));
+}
+
+
+///
+/// Result management
+///
+
+static Result zero = reinterpret_cast<Result>(0);
+static Result one = reinterpret_cast<Result>(1);
+
+void SparseSimulator::ReleaseResult(Result r) {}
+
+bool SparseSimulator::AreEqualResults(Result r1, Result r2)
+{
+    return (r1 == r2);
+}
+
+ResultValue SparseSimulator::GetResultValue(Result r)
+{
+    return (r == one) ? Result_One : Result_Zero;
+}
+
+Result SparseSimulator::UseZero()
+{
+    return zero;
+}
+
+Result SparseSimulator::UseOne()
+{
+    return one;
+}
+
+
+///
+/// Runtime driver instantiation
+///
+
+namespace Microsoft
+{
+namespace Quantum
+{
+    std::unique_ptr<IRuntimeDriver> CreateSparseSimulator(uint32_t userProvidedSeed, double pruneTolerance)
+    {
+        return std::make_unique<SparseSimulator>(userProvidedSeed, pruneTolerance);
+    }
+
+} // namespace Quantum
+} // namespace Microsoft
@@ -0,0 +1,274 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <bitset>
+#include <cmath>
+#include <complex>
+#include <random>
+
+#include "SparseSimulator.hpp"
+
+using namespace Microsoft::Quantum;
+using namespace std::complex_literals;
+
+# define PI 3.14159265358979323846
+
+
+static bool Parity(uint64_t bits)
+{
+    return std::bitset<64>(bits).count() % 2 == 1;
+}
+
+
+///
+/// Gate application
+///
+
+void SparseSimulator::ApplyGate(const Amplitude gate[2][2], long numControls, Qubit controls[], Qubit target)
+{
+    // Each basis state whose controls are set branches into both values of the target.
+    uint64_t controlMask = GetControlMask(numControls, controls);
+    uint64_t targetMask = GetQubitMask(target);
+    Transform([&](uint64_t index, Amplitude amp, SparseState& next) {
+        if ((index & controlMask) != controlMask) {
+            next.Add(index, amp);
+            return;
+        }
+        int bit = (index & targetMask) ? 1 : 0;
+        if (gate[0][bit] != 0.0)
+            next.Add(index & ~targetMask, gate[0][bit] * amp);
+        if (gate[1][bit] != 0.0)
+            next.Add(index | targetMask, gate[1][bit] * amp);
+    });
+}
+
+void SparseSimulator::ApplyDiagonalGate(Amplitude phase0, Amplitude phase1, long numControls, Qubit controls[], Qubit target)
+{
+    // Only the values change, so the map is updated in place.
+    uint64_t controlMask = GetControlMask(numControls, controls);
+    uint64_t targetMask = GetQubitMask(target);
+    this->state.ForEach([&](uint64_t index, Amplitude& amp) {
+        if ((index & controlMask) == controlMask)
+            amp *= (index & targetMask) ? phase1 : phase0;
+    });
+}
+
+void SparseSimulator::ApplyPermutationGate(Amplitude phase01, Amplitude phase10, long numControls, Qubit controls[], Qubit target)
+{
+    // |0⟩ → phase10 |1⟩ and |1⟩ → phase01 |0⟩.
+    uint64_t controlMask = GetControlMask(numControls, controls);
+    uint64_t targetMask = GetQubitMask(target);
+    if (controlMask == 0) {
+        // Flipping the target in all indices is done lazily by the map, so only the phases are applied here.
+        if (phase01 != 1.0 || phase10 != 1.0)
+            ApplyDiagonalGate(phase10, phase01, 0, nullptr, target);
+        this->state.Flip(targetMask);
+        return;
+    }
+    // The gate permutes the basis states, so the map is updated in place. Where both a basis state and its partner
+    // with the target flipped are present, the two just exchange their amplitudes. A basis state without its partner
+    // moves to the partner's index, which only these entries need to be erased and reinserted for.
+    this->movedAmplitudes.clear();
+    this->state.ForEach([&](uint64_t index, Amplitude& amp) {
+        if ((index & controlMask) != controlMask)
+            return;
+        Amplitude* partner = this->state.Lookup(index ^ targetMask);
+        if (partner == nullptr)
+            this->movedAmplitudes.emplace_back(index, amp);
+        else if (!(index & targetMask)) {
+            Amplitude amp0 = amp;
+            amp = phase01 * *partner;
+            *partner = phase10 * amp0;
+        }
+    });
+    for (const auto& [index, amp] : this->movedAmplitudes)
+        this->state.Erase(index);
+    for (const auto& [index, amp] : this->movedAmplitudes)
+        this->state.Add(index ^ targetMask, ((index & targetMask) ? phase01 : phase10) * amp);
+}
+
+SparseSimulator::PauliMasks SparseSimulator::GetPauliMasks(long numTargets, PauliId paulis[], Qubit targets[])
+{
+    // X|b⟩ = |b ^ 1⟩, Z|b⟩ = (-1)^b |b⟩ and Y|b⟩ = i (-1)^b |b ^ 1⟩.
+    PauliMasks masks;
+    for (long i = 0; i < numTargets; i++) {
+        uint64_t mask = GetQubitMask(targets[i]);
+        if (paulis[i] == PauliId_X || paulis[i] == PauliId_Y)
+            masks.flipMask |= mask;
+        if (paulis[i] == PauliId_Z || paulis[i] == PauliId_Y)
+            masks.phaseMask |= mask;
+        if (paulis[i] == PauliId_Y)
+            masks.phase *= 1i;
+    }
+    return masks;
+}
+
+void SparseSimulator::ApplyPauliRotation(long numControls, Qubit controls[],
+                                         long numTargets, PauliId paulis[], Qubit targets[], double theta)
+{
+    // exp(iθP)|k⟩ = cos θ |k⟩ + i sin θ P|k⟩, which is diagonal if P doesn't flip any qubits.
+    PauliMasks masks = GetPauliMasks(numTargets, paulis, targets);
+    uint64_t controlMask = GetControlMask(numControls, controls);
+    Amplitude c = cos(theta), s = 1i * sin(theta) * masks.phase;
+    if (masks.flipMask == 0) {
+        this->state.ForEach([&](uint64_t index, Amplitude& amp) {
+            if ((index & controlMask) == controlMask)
+                amp *= Parity(index & masks.phaseMask) ? c - s : c + s;
+        });
+        return;
+    }
+    Transform([&](uint64_t index, Amplitude amp, SparseState& next) {
+        if ((index & controlMask) != controlMask) {
+            next.Add(index, amp);
+            return;
+        }
+        next.Add(index, c * amp);
+        next.Add(index ^ masks.flipMask, (Parity(index & masks.phaseMask) ? -s : s) * amp);
+    });
+}
+
+
+///
+/// Supported quantum operations
+///
+
+void SparseSimulator::X(Qubit q)
+{
+    ApplyPermutationGate(1, 1, 0, nullptr, q);
+}
+
+void SparseSimulator::ControlledX(long numControls, Qubit controls[], Qubit target)
+{
+    ApplyPermutationGate(1, 1, numControls, controls, target);
+}
+
+void SparseSimulator::Y(Qubit q)
+{
+    ApplyPermutationGate(-1i, 1i, 0, nullptr, q);
+}
+
+void SparseSimulator::ControlledY(long numControls, Qubit controls[], Qubit target)
+{
+    ApplyPermutationGate(-1i, 1i, numControls, controls, target);
+}
+
+void SparseSimulator::Z(Qubit q)
+{
+    ApplyDiagonalGate(1, -1, 0, nullptr, q);
+}
+
+void SparseSimulator::ControlledZ(long numControls, Qubit controls[], Qubit target)
+{
+    ApplyDiagonalGate(1, -1, numControls, controls, target);
+}
+
+void SparseSimulator::H(Qubit q)
+{
+    ControlledH(0, nullptr, q);
+}
+
+void SparseSimulator::ControlledH(long numControls, Qubit controls[], Qubit target)
+{
+    static const double r = 1 / sqrt(2.0);
+    static const Amplitude h[2][2] = {{r, r}, {r, -r}};
+    ApplyGate(h, numControls, controls, target);
+}
+
+void SparseSimulator::S(Qubit q)
+{
+    ApplyDiagonalGate(1, 1i, 0, nullptr, q);
+}
+
+void SparseSimulator::ControlledS(long numControls, Qubit controls[], Qubit target)
+{
+    ApplyDiagonalGate(1, 1i, numControls, controls, target);
+}
+
+void SparseSimulator::AdjointS(Qubit q)
+{
+    ApplyDiagonalGate(1, -1i, 0, nullptr, q);
+}
+
+void SparseSimulator::ControlledAdjointS(long numControls, Qubit controls[], Qubit target)
+{
+    ApplyDiagonalGate(1, -1i, numControls, controls, target);
+}
+
+void SparseSimulator::T(Qubit q)
+{
+    ApplyDiagonalGate(1, exp(1i*PI/4.), 0, nullptr, q);
+}
+
+void SparseSimulator::ControlledT(long numControls, Qubit controls[], Qubit target)
+{
+    ApplyDiagonalGate(1, exp(1i*PI/4.), numControls, controls, target);
+}
+
+void SparseSimulator::AdjointT(Qubit q)
+{
+    ApplyDiagonalGate(1, exp(-1i*PI/4.), 0, nullptr, q);
+}
+
+void SparseSimulator::ControlledAdjointT(long numControls, Qubit controls[], Qubit target)
+{
+    ApplyDiagonalGate(1, exp(-1i*PI/4.), numControls, controls, target);
+}
+
+void SparseSimulator::R(PauliId axis, Qubit q, double theta)
+{
+    ControlledR(0, nullptr, axis, q, theta);
+}
+
+void SparseSimulator::ControlledR(long numControls, Qubit controls[], PauliId axis, Qubit target, double theta)
+{
+    // R_P(θ) = exp(-iθP/2).
+    ApplyPauliRotation(numControls, controls, 1, &axis, &target, -theta/2.0);
+}
+
+void SparseSimulator::Exp(long numTargets, PauliId paulis[], Qubit targets[], double theta)
+{
+    ApplyPauliRotation(0, nullptr, numTargets, paulis, targets, theta);
+}
+
+void SparseSimulator::ControlledExp(long numControls, Qubit controls[], long numTargets, PauliId paulis[], Qubit targets[], double theta)
+{
+    ApplyPauliRotation(numControls, controls, numTargets, paulis, targets, theta);
+}
+
+double SparseSimulator::Expectation(long numTargets, PauliId paulis[], Qubit targets[])
+{
+    // ⟨Ψ|P|Ψ⟩ = Σ_k phase (-1)^|k & phaseMask| conj(Ψ[k ^ flipMask]) Ψ[k], looking up the partner of each basis state.
+    PauliMasks masks = GetPauliMasks(numTargets, paulis, targets);
+    double expectation = 0, norm = 0;
+    this->state.ForEach([&](uint64_t index, Amplitude& amp) {
+        norm += std::norm(amp);
+        Amplitude partner = (masks.flipMask == 0) ? amp : this->state.Find(index ^ masks.flipMask);
+        double overlap = (masks.phase * std::conj(partner) * amp).real();
+        expectation += Parity(index & masks.phaseMask) ? -overlap : overlap;
+    });
+    return expectation / norm;
+}
+
+Result SparseSimulator::Measure(long numBases, PauliId bases[], long numTargets, Qubit targets[])
+{
+    // Project onto the ±1 eigenspace of P with (1 ± P)/2, which at most doubles the number of basis states,
+    // instead of rotating each qubit into the computational basis and back.
+    double probZero = (1.0 + Expectation(numTargets, bases, targets)) / 2.0;
+    double random0to1 = std::uniform_real_distribution<double>(0.0, 1.0)(this->rng);
+    Result outcome = random0to1 < probZero ? UseZero() : UseOne();
+
+    PauliMasks masks = GetPauliMasks(numTargets, bases, targets);
+    bool odd = (outcome == UseOne());
+    double factor = 1 / (2 * sqrt(odd ? 1.0 - probZero : probZero));
+    Transform([&](uint64_t index, Amplitude amp, SparseState& next) {
+        if (masks.flipMask == 0) {
+            if (Parity(index & masks.phaseMask) == odd)
+                next.Add(index, 2 * factor * amp);
+            return;
+        }
+        next.Add(index, factor * amp);
+        bool negative = Parity(index & masks.phaseMask) != odd;
+        next.Add(index ^ masks.flipMask, (negative ? -factor : factor) * masks.phase * amp);
+    });
+    return outcome;
+}
@@ -0,0 +1,204 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <complex>
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "QirRuntimeApi_I.hpp"
+#include "QSharpSimApi_I.hpp"
+
+#include "QubitManager.hpp"
+#include "SparseState.hpp"
+
+namespace Microsoft
+{
+namespace Quantum
+{
+    // Simulates the same gate set as the StateSimulator, but only stores the non-zero amplitudes of the state.
+    // Suited to circuits that keep few basis states in superposition, such as classical oracles and arithmetic,
+    // on up to 63 qubits. Permutation gates (X, Y, CNOT, ...) only change the keys of the amplitudes and diagonal
+    // gates only their values, while other gates branch each basis state into two.
+    class SparseSimulator : public IRuntimeDriver, public IQuantumGateSet, public IDiagnostics
+    {
+        using Amplitude = std::complex<double>;
+
+        // Associated qubit manager instance to handle qubit representation.
+        CQubitManager *qbm;
+
+        // The state of all qubits, where each qubit manager ID is a bit of the basis state index. Released qubits are
+        // reset to |0⟩, so that their bits are zero until the ID is handed out again. The second map is kept around
+        // to build the next state in.
+        SparseState state;
+        SparseState nextState;
+
+        // Amplitudes with a smaller magnitude are dropped whenever the state is rebuilt.
+        double pruneTolerance;
+
+        // Source of randomness for measurement outcomes.
+        std::mt19937_64 rng;
+
+        uint64_t GetQubitMask(Qubit q)
+        {
+            return uint64_t(1) << this->qbm->GetQubitId(q);
+        }
+
+        uint64_t GetControlMask(long numControls, Qubit controls[])
+        {
+            uint64_t mask = 0;
+            for (long i = 0; i < numControls; i++)
+                mask |= GetQubitMask(controls[i]);
+            return mask;
+        }
+
+        // Builds the next state by calling update(index, amp, nextState) for each amplitude of the current one,
+        // skipping those below the pruning tolerance.
+        template <typename F>
+        void Transform(F&& update)
+        {
+            double threshold = this->pruneTolerance * this->pruneTolerance;
+            this->nextState.Clear(this->state.size());
+            this->state.ForEach([&](uint64_t index, Amplitude& amp) {
+                if (std::norm(amp) >= threshold)
+                    update(index, amp, this->nextState);
+            });
+            std::swap(this->state, this->nextState);
+            // E.g. after a measurement, the new state may have far fewer entries than the table was sized for.
+            this->state.Shrink();
+        }
+
+        // Basis states moved to a new index by the current controlled permutation gate, with their amplitudes.
+        std::vector<std::pair<uint64_t, Amplitude>> movedAmplitudes;
+
+        // To be called by quantum gate set operations.
+        void ApplyGate(const Amplitude gate[2][2], long numControls, Qubit controls[], Qubit target);
+        void ApplyDiagonalGate(Amplitude phase0, Amplitude phase1, long numControls, Qubit controls[], Qubit target);
+        void ApplyPermutationGate(Amplitude phase01, Amplitude phase10, long numControls, Qubit controls[], Qubit target);
+
+        // Applies exp(iθP) for the Pauli string P over the targets, controlled on the given qubits.
+        void ApplyPauliRotation(long numControls, Qubit controls[],
+                                long numTargets, PauliId paulis[], Qubit targets[], double theta);
+
+        // A Pauli string P maps each basis state to a single other one, P|k⟩ = phase (-1)^|k & phaseMask| |k ^ flipMask⟩.
+        struct PauliMasks
+        {
+            uint64_t flipMask = 0;
+            uint64_t phaseMask = 0;
+            Amplitude phase = 1;
+        };
+        PauliMasks GetPauliMasks(long numTargets, PauliId paulis[], Qubit targets[]);
+
+        // Returns ⟨Ψ|P|Ψ⟩ for the Pauli string P over the targets.
+        double Expectation(long numTargets, PauliId paulis[], Qubit targets[]);
+
+      public:
+        SparseSimulator(uint32_t userProvidedSeed = 0, double pruneTolerance = 1e-10)
+            : pruneTolerance(pruneTolerance), rng(userProvidedSeed)
+        {
+            this->qbm = new CQubitManager();
+            this->state.Add(0, 1);
+        }
+        ~SparseSimulator()
+        {
+            delete this->qbm;
+        }
+
+        // Number of basis states currently stored.
+        std::size_t GetNumAmplitudes() const
+        {
+            return this->state.size();
+        }
+
+
+        ///
+        /// Implementation of IRuntimeDriver
+        ///
+        void ReleaseResult(Result r) override;
+
+        bool AreEqualResults(Result r1, Result r2) override;
+
+        ResultValue GetResultValue(Result r) override;
+
+        Result UseZero() override;
+
+        Result UseOne() override;
+
+        Qubit AllocateQubit() override;
+
+        void ReleaseQubit(Qubit q) override;
+
+        std::string QubitToString(Qubit q) override;
+
+
+        ///
+        /// Implementation of IQuantumGateSet
+        ///
+        void X(Qubit q) override;
+
+        void ControlledX(long numControls, Qubit controls[], Qubit target) override;
+
+        void Y(Qubit q) override;
+
+        void ControlledY(long numControls, Qubit controls[], Qubit target) override;
+
+        void Z(Qubit q) override;
+
+        void ControlledZ(long numControls, Qubit controls[], Qubit target) override;
+
+        void H(Qubit q) override;
+
+        void ControlledH(long numControls, Qubit controls[], Qubit target) override;
+
+        void S(Qubit q) override;
+
+        void ControlledS(long numControls, Qubit controls[], Qubit target) override;
+
+        void AdjointS(Qubit q) override;
+
+        void ControlledAdjointS(long numControls, Qubit controls[], Qubit target) override;
+
+        void T(Qubit q) override;
+
+        void ControlledT(long numControls, Qubit controls[], Qubit target) override;
+
+        void AdjointT(Qubit q) override;
+
+        void ControlledAdjointT(long numControls, Qubit controls[], Qubit target) override;
+
+        void R(PauliId axis, Qubit target, double theta) override;
+
+        void ControlledR(long numControls, Qubit controls[], PauliId axis, Qubit target, double theta) override;
+
+        void Exp(long numTargets, PauliId paulis[], Qubit targets[], double theta) override;
+
+        void ControlledExp(long numControls, Qubit controls[], long numTargets, PauliId paulis[], Qubit targets[], double theta) override;
+
+        Result Measure(long numBases, PauliId bases[], long numTargets, Qubit targets[]) override;
+
+
+        ///
+        /// Implementation of IDiagnostics
+        ///
+        bool Assert(long numTargets, PauliId* bases, Qubit* targets, Result result, const char* failureMessage) override;
+
+        bool AssertProbability(long numTargets, PauliId bases[], Qubit targets[], double probabilityOfZero, double precision, const char* failureMessage) override;
+
+        // Deprecated, use `DumpMachine()` and `DumpRegister()` instead.
+        void GetState(TGetStateCallback callback) override;
+
+        void DumpMachine(const void* location) override;
+
+        void DumpRegister(const void* location, const QirArray* qubits) override;
+
+    }; // class SparseSimulator
+
+    // Amplitudes below the pruning tolerance in magnitude are dropped, to keep rounding errors from adding entries.
+    std::unique_ptr<IRuntimeDriver> CreateSparseSimulator(uint32_t userProvidedSeed = 0, double pruneTolerance = 1e-10);
+
+} // namespace Quantum
+} // namespace Microsoft
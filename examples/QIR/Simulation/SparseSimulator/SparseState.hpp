@@ -0,0 +1,178 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Microsoft
+{
+namespace Quantum
+{
+    // The non-zero amplitudes of a state, stored in an open-addressing hash map from basis state index to amplitude.
+    // Slots are probed linearly from a multiplicative hash of the index, which keeps lookups within a cache line or
+    // two as long as the map is at most half full. Gates that branch basis states build a new map instead of
+    // updating this one (see SparseSimulator::Transform), while permutations move the few entries they need to.
+    // Since sweeps over the map visit every slot, the table is shrunk again once it is mostly empty.
+    class SparseState
+    {
+        using Amplitude = std::complex<double>;
+
+        // Marks an empty slot. Basis states use at most 63 bits, so that this is never a valid index.
+        static constexpr uint64_t emptyKey = ~uint64_t(0);
+
+        struct Entry
+        {
+            uint64_t key;
+            Amplitude amp;
+        };
+
+        std::vector<Entry> slots;
+        std::size_t count = 0;
+        unsigned shift = 64;
+
+        // Bits flipped in all indices, which makes an uncontrolled X gate a constant-time operation.
+        // Stored keys are the actual basis state indices XOR flipMask.
+        uint64_t flipMask = 0;
+
+        std::size_t Home(uint64_t key) const
+        {
+            return (key * 0x9e3779b97f4a7c15) >> this->shift;
+        }
+
+        // Smallest table that holds the given number of entries at most a quarter full.
+        static std::size_t CapacityFor(std::size_t count)
+        {
+            std::size_t capacity = 16;
+            while (capacity < 4 * count)
+                capacity *= 2;
+            return capacity;
+        }
+
+        void Rehash(std::size_t capacity)
+        {
+            std::vector<Entry> old(capacity, Entry{emptyKey, 0});
+            old.swap(this->slots);
+            this->shift = 64;
+            for (std::size_t c = capacity; c > 1; c >>= 1)
+                this->shift--;
+            for (const Entry& entry : old) {
+                if (entry.key == emptyKey)
+                    continue;
+                std::size_t i = Home(entry.key);
+                while (this->slots[i].key != emptyKey)
+                    i = (i + 1) & (this->slots.size() - 1);
+                this->slots[i] = entry;
+            }
+        }
+
+      public:
+        SparseState()
+        {
+            Rehash(16);
+        }
+
+        std::size_t size() const { return this->count; }
+
+        // Removes all entries, keeping the memory of the table unless it is much larger than needed for the
+        // expected number of entries.
+        void Clear(std::size_t expectedCount = 0)
+        {
+            this->count = 0;
+            this->flipMask = 0;
+            std::size_t capacity = CapacityFor(expectedCount);
+            if (this->slots.size() > 8 * capacity) {
+                this->slots.clear();
+                Rehash(capacity);
+                return;
+            }
+            for (Entry& entry : this->slots)
+                entry.key = emptyKey;
+        }
+
+        // Moves the entries to a smaller table if at most an eighth of the slots are in use.
+        void Shrink()
+        {
+            if (this->slots.size() > 8 * CapacityFor(this->count))
+                Rehash(CapacityFor(this->count));
+        }
+
+        // Adds the amplitude to the given basis state, inserting it if not present.
+        void Add(uint64_t index, Amplitude amp)
+        {
+            uint64_t key = index ^ this->flipMask;
+            std::size_t i = Home(key);
+            while (this->slots[i].key != emptyKey) {
+                if (this->slots[i].key == key) {
+                    this->slots[i].amp += amp;
+                    return;
+                }
+                i = (i + 1) & (this->slots.size() - 1);
+            }
+            this->slots[i] = {key, amp};
+            if (2 * ++this->count > this->slots.size())
+                Rehash(2 * this->slots.size());
+        }
+
+        // Returns the amplitude of the given basis state, which is zero if not present.
+        Amplitude Find(uint64_t index) const
+        {
+            uint64_t key = index ^ this->flipMask;
+            for (std::size_t i = Home(key); this->slots[i].key != emptyKey; i = (i + 1) & (this->slots.size() - 1))
+                if (this->slots[i].key == key)
+                    return this->slots[i].amp;
+            return 0;
+        }
+
+        // Returns the amplitude of the given basis state for modification, or nullptr if not present.
+        Amplitude* Lookup(uint64_t index)
+        {
+            uint64_t key = index ^ this->flipMask;
+            for (std::size_t i = Home(key); this->slots[i].key != emptyKey; i = (i + 1) & (this->slots.size() - 1))
+                if (this->slots[i].key == key)
+                    return &this->slots[i].amp;
+            return nullptr;
+        }
+
+        // Removes the given basis state if present. Later entries of its probe sequence are shifted back into the
+        // freed slot where their own sequence allows it, so that lookups never stop at the gap too early.
+        void Erase(uint64_t index)
+        {
+            uint64_t key = index ^ this->flipMask;
+            std::size_t mask = this->slots.size() - 1;
+            std::size_t i = Home(key);
+            while (this->slots[i].key != key) {
+                if (this->slots[i].key == emptyKey)
+                    return;
+                i = (i + 1) & mask;
+            }
+            for (std::size_t j = (i + 1) & mask; this->slots[j].key != emptyKey; j = (j + 1) & mask) {
+                // The entry in slot j may move to slot i if i lies between its home slot and j.
+                if (((j - Home(this->slots[j].key)) & mask) >= ((j - i) & mask)) {
+                    this->slots[i] = this->slots[j];
+                    i = j;
+                }
+            }
+            this->slots[i].key = emptyKey;
+            this->count--;
+        }
+
+        // Calls body(index, amp) for each entry, where amp may be modified in place.
+        template <typename F>
+        void ForEach(F&& body)
+        {
+            for (Entry& entry : this->slots)
+                if (entry.key != emptyKey)
+                    body(entry.key ^ this->flipMask, entry.amp);
+        }
+
+        // Flips the given bits of all basis state indices.
+        void Flip(uint64_t mask)
+        {
+            this->flipMask ^= mask;
+        }
+    };
+
+} // namespace Quantum
+} // namespace Microsoft
@@ -0,0 +1,61 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+#include "StabilizerSimulator.hpp"
+
+using namespace Microsoft::Quantum;
+
+
+///
+/// State inspection
+///
+
+void StabilizerSimulator::GetState(TGetStateCallback callback)
+{
+    // The amplitudes aren't tracked, and listing all of them would take exponential time.
+    throw std::logic_error("operation_not_supported");
+}
+
+void StabilizerSimulator::DumpMachine(const void* location)
+{
+    // The state is printed to the console as its stabilizer generators, regardless of the location provided.
+    // Columns are qubit IDs, including those of released qubits, which are in |0⟩.
+    std::cout << "# stabilizer generators (qubits by ID):\n";
+    for (std::size_t q = 0; q < this->tableau.NumQubits(); q++) {
+        std::cout << (this->tableau.StabilizerSign(q) ? "-" : "+");
+        for (std::size_t qubit = 0; qubit < this->tableau.NumQubits(); qubit++) {
+            auto [x, z] = this->tableau.StabilizerBits(q, qubit);
+            std::cout << (x ? (z ? 'Y' : 'X') : (z ? 'Z' : 'I'));
+        }
+        std::cout << "\n";
+    }
+    std::cout << std::flush;
+}
+
+void StabilizerSimulator::DumpRegister(const void* location, const QirArray* qubits)
+{
+    throw std::logic_error("operation_not_supported");
+}
+
+
+///
+/// Assertions
+///
+
+bool StabilizerSimulator::Assert(long numTargets, PauliId* bases, Qubit* targets, Result result, const char* failureMessage)
+{
+    // Stabilizer states give each Pauli measurement outcome with probability 0, 1/2 or 1, which is exact.
+    double probabilityOfZero = (result == UseZero()) ? 1.0 : 0.0;
+    return AssertProbability(numTargets, bases, targets, probabilityOfZero, 1e-10, failureMessage);
+}
+
+bool StabilizerSimulator::AssertProbability(long numTargets, PauliId bases[], Qubit targets[], double probabilityOfZero, double precision, const char* failureMessage)
+{
+    int expectation = this->tableau.Expectation(MakePauliString(numTargets, bases, targets));
+    double actualProbabilityOfZero = (1.0 + expectation) / 2.0;
+    return std::abs(actualProbabilityOfZero - probabilityOfZero) < precision;
+}
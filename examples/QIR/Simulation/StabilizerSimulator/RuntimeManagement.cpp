@@ -0,0 +1,80 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "StabilizerSimulator.hpp"
+
+using namespace Microsoft::Quantum;
+
+
+///
+/// Qubit management
+///
+
+Qubit StabilizerSimulator::AllocateQubit()
+{
+    Qubit q = this->qbm->Allocate();
+    while (GetQubitIdx(q) >= this->tableau.NumQubits())
+        this->tableau.AddQubit();  // |0⟩
+    return q;
+}
+
+void StabilizerSimulator::ReleaseQubit(Qubit q)
+{
+    // Reset the qubit to |0⟩, which disentangles it from the others, so that its column can be reused as is.
+    PauliId z = PauliId_Z;
+    if (Measure(1, &z, 1, &q) == UseOne())
+        X(q);
+    this->qbm->Release(q);
+}
+
+std::string StabilizerSimulator::QubitToString(Qubit q)
+{
+    return std::to_string(this->qbm->GetQubitId(q));
+}
+
+
+///
+/// Result management
+///
+
+static Result zero = reinterpret_cast<Result>(0);
+static Result one = reinterpret_cast<Result>(1);
+
+void StabilizerSimulator::ReleaseResult(Result r) {}
+
+bool StabilizerSimulator::AreEqualResults(Result r1, Result r2)
+{
+    return (r1 == r2);
+}
+
+ResultValue StabilizerSimulator::GetResultValue(Result r)
+{
+    return (r == one) ? Result_One : Result_Zero;
+}
+
+Result StabilizerSimulator::UseZero()
+{
+    return zero;
+}
+
+Result StabilizerSimulator::UseOne()
+{
+    return one;
+}
+
+
+///
+/// Runtime driver instantiation
+///
+
+namespace Microsoft
+{
+namespace Quantum
+{
+    std::unique_ptr<IRuntimeDriver> CreateStabilizerSimulator(uint32_t userProvidedSeed)
+    {
+        return std::make_unique<StabilizerSimulator>(userProvidedSeed);
+    }
+
+} // namespace Quantum
+} // namespace Microsoft
@@ -0,0 +1,163 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <cstddef>
+#include <stdexcept>
+
+#include "StabilizerSimulator.hpp"
+
+using namespace Microsoft::Quantum;
+
+
+///
+/// Supported quantum operations
+///
+
+void StabilizerSimulator::X(Qubit q)
+{
+    this->tableau.ApplyX(GetQubitIdx(q));
+}
+
+void StabilizerSimulator::ControlledX(long numControls, Qubit controls[], Qubit target)
+{
+    if (numControls == 0)
+        return X(target);
+    if (numControls > 1)
+        throw std::logic_error("non_clifford_operation");
+    this->tableau.ApplyCX(GetQubitIdx(controls[0]), GetQubitIdx(target));
+}
+
+void StabilizerSimulator::Y(Qubit q)
+{
+    this->tableau.ApplyY(GetQubitIdx(q));
+}
+
+void StabilizerSimulator::ControlledY(long numControls, Qubit controls[], Qubit target)
+{
+    if (numControls == 0)
+        return Y(target);
+    if (numControls > 1)
+        throw std::logic_error("non_clifford_operation");
+    this->tableau.ApplyCY(GetQubitIdx(controls[0]), GetQubitIdx(target));
+}
+
+void StabilizerSimulator::Z(Qubit q)
+{
+    this->tableau.ApplyZ(GetQubitIdx(q));
+}
+
+void StabilizerSimulator::ControlledZ(long numControls, Qubit controls[], Qubit target)
+{
+    if (numControls == 0)
+        return Z(target);
+    if (numControls > 1)
+        throw std::logic_error("non_clifford_operation");
+    this->tableau.ApplyCZ(GetQubitIdx(controls[0]), GetQubitIdx(target));
+}
+
+void StabilizerSimulator::H(Qubit q)
+{
+    this->tableau.ApplyH(GetQubitIdx(q));
+}
+
+void StabilizerSimulator::ControlledH(long numControls, Qubit controls[], Qubit target)
+{
+    if (numControls > 0)
+        throw std::logic_error("non_clifford_operation");
+    H(target);
+}
+
+void StabilizerSimulator::S(Qubit q)
+{
+    this->tableau.ApplyS(GetQubitIdx(q));
+}
+
+void StabilizerSimulator::ControlledS(long numControls, Qubit controls[], Qubit target)
+{
+    if (numControls > 0)
+        throw std::logic_error("non_clifford_operation");
+    S(target);
+}
+
+void StabilizerSimulator::AdjointS(Qubit q)
+{
+    this->tableau.ApplyAdjointS(GetQubitIdx(q));
+}
+
+void StabilizerSimulator::ControlledAdjointS(long numControls, Qubit controls[], Qubit target)
+{
+    if (numControls > 0)
+        throw std::logic_error("non_clifford_operation");
+    AdjointS(target);
+}
+
+
+///
+/// Non-Clifford operations
+///
+
+void StabilizerSimulator::T(Qubit q)
+{
+    throw std::logic_error("non_clifford_operation");
+}
+
+void StabilizerSimulator::ControlledT(long numControls, Qubit controls[], Qubit target)
+{
+    throw std::logic_error("non_clifford_operation");
+}
+
+void StabilizerSimulator::AdjointT(Qubit q)
+{
+    throw std::logic_error("non_clifford_operation");
+}
+
+void StabilizerSimulator::ControlledAdjointT(long numControls, Qubit controls[], Qubit target)
+{
+    throw std::logic_error("non_clifford_operation");
+}
+
+void StabilizerSimulator::R(PauliId axis, Qubit target, double theta)
+{
+    throw std::logic_error("non_clifford_operation");
+}
+
+void StabilizerSimulator::ControlledR(long numControls, Qubit controls[], PauliId axis, Qubit target, double theta)
+{
+    throw std::logic_error("non_clifford_operation");
+}
+
+void StabilizerSimulator::Exp(long numTargets, PauliId paulis[], Qubit targets[], double theta)
+{
+    throw std::logic_error("non_clifford_operation");
+}
+
+void StabilizerSimulator::ControlledExp(long numControls, Qubit controls[], long numTargets, PauliId paulis[], Qubit targets[], double theta)
+{
+    throw std::logic_error("non_clifford_operation");
+}
+
+
+///
+/// Measurement
+///
+
+PauliString StabilizerSimulator::MakePauliString(long numTargets, PauliId paulis[], Qubit targets[])
+{
+    PauliString p(this->tableau.NumWords());
+    for (long i = 0; i < numTargets; i++) {
+        std::size_t q = GetQubitIdx(targets[i]);
+        uint64_t mask = uint64_t(1) << (q % 64);
+        if (paulis[i] == PauliId_X || paulis[i] == PauliId_Y)
+            p.xs[q / 64] |= mask;
+        if (paulis[i] == PauliId_Z || paulis[i] == PauliId_Y)
+            p.zs[q / 64] |= mask;
+    }
+    return p;
+}
+
+Result StabilizerSimulator::Measure(long numBases, PauliId bases[], long numTargets, Qubit targets[])
+{
+    PauliString p = MakePauliString(numTargets, bases, targets);
+    bool outcome = this->tableau.Measure(p, [this]() { return (this->rng() & 1) == 1; });
+    return outcome ? UseOne() : UseZero();
+}
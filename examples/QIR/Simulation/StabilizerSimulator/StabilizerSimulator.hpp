@@ -0,0 +1,140 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include "QirRuntimeApi_I.hpp"
+#include "QSharpSimApi_I.hpp"
+
+#include "QubitManager.hpp"
+#include "Tableau.hpp"
+
+namespace Microsoft
+{
+namespace Quantum
+{
+    // Simulates circuits made of Clifford gates (X, Y, Z, H, S, CNOT, CY, CZ) and Pauli measurements in polynomial
+    // time, by tracking the stabilizer tableau of the state instead of its amplitudes.
+    // Non-Clifford operations such as T, R, Exp, or gates with more than one control throw "non_clifford_operation".
+    class StabilizerSimulator : public IRuntimeDriver, public IQuantumGateSet, public IDiagnostics
+    {
+        // Associated qubit manager instance to handle qubit representation.
+        CQubitManager *qbm;
+
+        // The state of all qubits, where each qubit manager ID is a column of the tableau. Released qubits are
+        // reset to |0⟩ and stay in the tableau, so that their column can be handed out again.
+        Tableau tableau;
+
+        // Source of randomness for measurement outcomes.
+        std::mt19937_64 rng;
+
+        std::size_t GetQubitIdx(Qubit q)
+        {
+            return this->qbm->GetQubitId(q);
+        }
+
+        // Returns the product of the given Paulis on the targets, with a positive sign.
+        PauliString MakePauliString(long numTargets, PauliId paulis[], Qubit targets[]);
+
+      public:
+        StabilizerSimulator(uint32_t userProvidedSeed = 0)
+            : rng(userProvidedSeed)
+        {
+            this->qbm = new CQubitManager();
+        }
+        ~StabilizerSimulator()
+        {
+            delete this->qbm;
+        }
+
+
+        ///
+        /// Implementation of IRuntimeDriver
+        ///
+        void ReleaseResult(Result r) override;
+
+        bool AreEqualResults(Result r1, Result r2) override;
+
+        ResultValue GetResultValue(Result r) override;
+
+        Result UseZero() override;
+
+        Result UseOne() override;
+
+        Qubit AllocateQubit() override;
+
+        void ReleaseQubit(Qubit q) override;
+
+        std::string QubitToString(Qubit q) override;
+
+
+        ///
+        /// Implementation of IQuantumGateSet
+        ///
+        void X(Qubit q) override;
+
+        void ControlledX(long numControls, Qubit controls[], Qubit target) override;
+
+        void Y(Qubit q) override;
+
+        void ControlledY(long numControls, Qubit controls[], Qubit target) override;
+
+        void Z(Qubit q) override;
+
+        void ControlledZ(long numControls, Qubit controls[], Qubit target) override;
+
+        void H(Qubit q) override;
+
+        void ControlledH(long numControls, Qubit controls[], Qubit target) override;
+
+        void S(Qubit q) override;
+
+        void ControlledS(long numControls, Qubit controls[], Qubit target) override;
+
+        void AdjointS(Qubit q) override;
+
+        void ControlledAdjointS(long numControls, Qubit controls[], Qubit target) override;
+
+        void T(Qubit q) override;
+
+        void ControlledT(long numControls, Qubit controls[], Qubit target) override;
+
+        void AdjointT(Qubit q) override;
+
+        void ControlledAdjointT(long numControls, Qubit controls[], Qubit target) override;
+
+        void R(PauliId axis, Qubit target, double theta) override;
+
+        void ControlledR(long numControls, Qubit controls[], PauliId axis, Qubit target, double theta) override;
+
+        void Exp(long numTargets, PauliId paulis[], Qubit targets[], double theta) override;
+
+        void ControlledExp(long numControls, Qubit controls[], long numTargets, PauliId paulis[], Qubit targets[], double theta) override;
+
+        Result Measure(long numBases, PauliId bases[], long numTargets, Qubit targets[]) override;
+
+
+        ///
+        /// Implementation of IDiagnostics
+        ///
+        bool Assert(long numTargets, PauliId* bases, Qubit* targets, Result result, const char* failureMessage) override;
+
+        bool AssertProbability(long numTargets, PauliId bases[], Qubit targets[], double probabilityOfZero, double precision, const char* failureMessage) override;
+
+        // Deprecated, use `DumpMachine()` and `DumpRegister()` instead.
+        void GetState(TGetStateCallback callback) override;
+
+        void DumpMachine(const void* location) override;
+
+        void DumpRegister(const void* location, const QirArray* qubits) override;
+
+    }; // class StabilizerSimulator
+
+    std::unique_ptr<IRuntimeDriver> CreateStabilizerSimulator(uint32_t userProvidedSeed = 0);
+
+} // namespace Quantum
+} // namespace Microsoft
@@ -0,0 +1,268 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <algorithm>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace Microsoft
+{
+namespace Quantum
+{
+    // A signed product of single-qubit Pauli operators, where qubit q is given by bit q of the x and z bits:
+    // (x, z) = (0, 0), (1, 0), (1, 1) and (0, 1) stand for I, X, Y and Z respectively.
+    struct PauliString
+    {
+        std::vector<uint64_t> xs;
+        std::vector<uint64_t> zs;
+        bool sign = false;
+
+        explicit PauliString(std::size_t numWords)
+            : xs(numWords, 0), zs(numWords, 0)
+        {
+        }
+    };
+
+    // Stabilizer tableau after Aaronson and Gottesman (https://arxiv.org/abs/quant-ph/0406196), which represents a
+    // stabilizer state of n qubits by n stabilizer generators and n matching destabilizers, taking O(n^2) bits
+    // instead of the 2^n amplitudes of the state vector.
+    // Rows are bit-packed into 64-bit words, so that multiplying two rows or checking whether they commute handles
+    // 64 qubits per instruction. Row 2q is destabilizer q and row 2q+1 is stabilizer q, so that adding a qubit only
+    // appends rows, and each row has room for a multiple of 64 qubits that is doubled when it runs out.
+    class Tableau
+    {
+        static constexpr std::size_t wordBits = 64;
+
+        std::size_t numQubits = 0;
+        std::size_t numWords = 0;
+
+        // Row r is stored in the words [r * numWords, (r + 1) * numWords) of xs and zs.
+        std::vector<uint64_t> xs;
+        std::vector<uint64_t> zs;
+        std::vector<bool> signs;
+
+        static std::size_t Popcount(uint64_t bits)
+        {
+            return std::bitset<wordBits>(bits).count();
+        }
+
+        // Sets (x, z, sign) to the product of (srcX, srcZ, srcSign) with it, assuming the two commute.
+        static void MultiplyInto(const uint64_t* srcX, const uint64_t* srcZ, bool srcSign,
+                                 uint64_t* x, uint64_t* z, bool& sign, std::size_t numWords)
+        {
+            // Multiplying two Paulis on the same qubit gives a factor of i, -i or 1, e.g. XY = iZ and YX = -iZ.
+            // The exponent of i is summed up over all qubits mod 4, and is either 0 or 2 for commuting strings.
+            long phase = 2*srcSign + 2*sign;
+            for (std::size_t w = 0; w < numWords; w++) {
+                uint64_t x1 = srcX[w], z1 = srcZ[w], x2 = x[w], z2 = z[w];
+                uint64_t plusI = (x1 & ~z1 & x2 & z2) | (x1 & z1 & ~x2 & z2) | (~x1 & z1 & x2 & ~z2);
+                uint64_t minusI = (x1 & ~z1 & ~x2 & z2) | (x1 & z1 & x2 & ~z2) | (~x1 & z1 & x2 & z2);
+                phase += long(Popcount(plusI)) - long(Popcount(minusI));
+                x[w] = x1 ^ x2;
+                z[w] = z1 ^ z2;
+            }
+            sign = (phase & 3) == 2;
+        }
+
+        static bool Anticommute(const uint64_t* x1, const uint64_t* z1, const uint64_t* x2, const uint64_t* z2,
+                                std::size_t numWords)
+        {
+            uint64_t parity = 0;
+            for (std::size_t w = 0; w < numWords; w++)
+                parity ^= (x1[w] & z2[w]) ^ (z1[w] & x2[w]);
+            return Popcount(parity) % 2 == 1;
+        }
+
+        uint64_t* X(std::size_t row) { return &this->xs[row * this->numWords]; }
+        uint64_t* Z(std::size_t row) { return &this->zs[row * this->numWords]; }
+
+        bool Anticommutes(std::size_t row, const PauliString& p)
+        {
+            return Anticommute(X(row), Z(row), p.xs.data(), p.zs.data(), this->numWords);
+        }
+
+        // Sets row `target` to the product of row `source` with it.
+        void MultiplyRows(std::size_t source, std::size_t target)
+        {
+            bool sign = this->signs[target];
+            MultiplyInto(X(source), Z(source), this->signs[source], X(target), Z(target), sign, this->numWords);
+            this->signs[target] = sign;
+        }
+
+        // Moves the rows into a layout with room for the given number of words per row.
+        void Relayout(std::size_t newNumWords)
+        {
+            std::size_t numRows = 2 * this->numQubits;
+            std::vector<uint64_t> newXs(numRows * newNumWords, 0);
+            std::vector<uint64_t> newZs(numRows * newNumWords, 0);
+            for (std::size_t row = 0; row < numRows; row++) {
+                std::copy(X(row), X(row) + this->numWords, &newXs[row * newNumWords]);
+                std::copy(Z(row), Z(row) + this->numWords, &newZs[row * newNumWords]);
+            }
+            this->xs = std::move(newXs);
+            this->zs = std::move(newZs);
+            this->numWords = newNumWords;
+        }
+
+        // Calls update(x, z, sign) with references to the given qubit's bits in each row.
+        template <typename F>
+        void ForEachRow(std::size_t qubit, F&& update)
+        {
+            std::size_t word = qubit / wordBits;
+            uint64_t mask = uint64_t(1) << (qubit % wordBits);
+            for (std::size_t row = 0; row < 2 * this->numQubits; row++) {
+                bool x = X(row)[word] & mask, z = Z(row)[word] & mask, sign = this->signs[row];
+                update(x, z, sign);
+                X(row)[word] = x ? (X(row)[word] | mask) : (X(row)[word] & ~mask);
+                Z(row)[word] = z ? (Z(row)[word] | mask) : (Z(row)[word] & ~mask);
+                this->signs[row] = sign;
+            }
+        }
+
+      public:
+        std::size_t NumQubits() const { return this->numQubits; }
+        std::size_t NumWords() const { return this->numWords; }
+
+        // Returns the sign and Pauli operator of the given qubit in stabilizer generator q.
+        bool StabilizerSign(std::size_t q) const { return this->signs[2*q + 1]; }
+        std::pair<bool, bool> StabilizerBits(std::size_t q, std::size_t qubit) const
+        {
+            std::size_t i = (2*q + 1) * this->numWords + qubit / wordBits;
+            uint64_t mask = uint64_t(1) << (qubit % wordBits);
+            return {(this->xs[i] & mask) != 0, (this->zs[i] & mask) != 0};
+        }
+
+        // Adds a qubit in state |0⟩, with destabilizer X and stabilizer Z.
+        void AddQubit()
+        {
+            std::size_t q = this->numQubits;
+            if (q == this->numWords * wordBits)
+                Relayout(std::max<std::size_t>(1, 2 * this->numWords));
+            this->numQubits++;
+            this->xs.resize(2 * this->numQubits * this->numWords, 0);
+            this->zs.resize(2 * this->numQubits * this->numWords, 0);
+            this->signs.resize(2 * this->numQubits, false);
+            X(2*q)[q / wordBits] |= uint64_t(1) << (q % wordBits);
+            Z(2*q + 1)[q / wordBits] |= uint64_t(1) << (q % wordBits);
+        }
+
+        ///
+        /// Clifford gates
+        ///
+
+        // Each gate conjugates the Pauli operators of its qubits in every row, flipping the sign where needed.
+        void ApplyX(std::size_t q)
+        {
+            ForEachRow(q, [](bool& x, bool& z, bool& sign) { sign ^= z; });
+        }
+
+        void ApplyY(std::size_t q)
+        {
+            ForEachRow(q, [](bool& x, bool& z, bool& sign) { sign ^= x ^ z; });
+        }
+
+        void ApplyZ(std::size_t q)
+        {
+            ForEachRow(q, [](bool& x, bool& z, bool& sign) { sign ^= x; });
+        }
+
+        void ApplyH(std::size_t q)
+        {
+            ForEachRow(q, [](bool& x, bool& z, bool& sign) { sign ^= x & z; std::swap(x, z); });
+        }
+
+        void ApplyS(std::size_t q)
+        {
+            ForEachRow(q, [](bool& x, bool& z, bool& sign) { sign ^= x & z; z ^= x; });
+        }
+
+        void ApplyAdjointS(std::size_t q)
+        {
+            ForEachRow(q, [](bool& x, bool& z, bool& sign) { sign ^= x & !z; z ^= x; });
+        }
+
+        void ApplyCX(std::size_t control, std::size_t target)
+        {
+            std::size_t cWord = control / wordBits, tWord = target / wordBits;
+            uint64_t cMask = uint64_t(1) << (control % wordBits), tMask = uint64_t(1) << (target % wordBits);
+            for (std::size_t row = 0; row < 2 * this->numQubits; row++) {
+                bool xc = X(row)[cWord] & cMask, zc = Z(row)[cWord] & cMask;
+                bool xt = X(row)[tWord] & tMask, zt = Z(row)[tWord] & tMask;
+                if (xc && zt && (xt == zc))
+                    this->signs[row] = !this->signs[row];
+                if (xc)
+                    X(row)[tWord] ^= tMask;
+                if (zt)
+                    Z(row)[cWord] ^= cMask;
+            }
+        }
+
+        void ApplyCZ(std::size_t control, std::size_t target)
+        {
+            ApplyH(target);
+            ApplyCX(control, target);
+            ApplyH(target);
+        }
+
+        void ApplyCY(std::size_t control, std::size_t target)
+        {
+            ApplyAdjointS(target);
+            ApplyCX(control, target);
+            ApplyS(target);
+        }
+
+        ///
+        /// Measurement
+        ///
+
+        // Returns +1 or -1 if the state is an eigenstate of the Pauli string with that eigenvalue, or 0 if
+        // measuring it gives either outcome with equal probability. Doesn't change the state.
+        int Expectation(const PauliString& p)
+        {
+            for (std::size_t q = 0; q < this->numQubits; q++)
+                if (Anticommutes(2*q + 1, p))
+                    return 0;
+
+            // Up to its sign, p is the product of the stabilizers whose destabilizers it anticommutes with.
+            PauliString product(this->numWords);
+            for (std::size_t q = 0; q < this->numQubits; q++)
+                if (Anticommutes(2*q, p))
+                    MultiplyInto(X(2*q + 1), Z(2*q + 1), this->signs[2*q + 1],
+                                 product.xs.data(), product.zs.data(), product.sign, this->numWords);
+            return (product.sign == p.sign) ? 1 : -1;
+        }
+
+        // Measures the Pauli string, returning true for the -1 eigenvalue. When the outcome isn't determined
+        // by the state, it is taken from randomBit() and the state is collapsed accordingly.
+        template <typename F>
+        bool Measure(const PauliString& p, F&& randomBit)
+        {
+            std::size_t pivot = 0;
+            while (pivot < this->numQubits && !Anticommutes(2*pivot + 1, p))
+                pivot++;
+            if (pivot == this->numQubits)
+                return Expectation(p) < 0;
+
+            // Make all other rows commute with p by multiplying them with the pivot stabilizer, which then
+            // becomes the destabilizer of the new stabilizer ±p.
+            std::size_t pivotRow = 2*pivot + 1;
+            for (std::size_t row = 0; row < 2 * this->numQubits; row++)
+                if (row != pivotRow && Anticommutes(row, p))
+                    MultiplyRows(pivotRow, row);
+            std::copy(X(pivotRow), X(pivotRow) + this->numWords, X(pivotRow - 1));
+            std::copy(Z(pivotRow), Z(pivotRow) + this->numWords, Z(pivotRow - 1));
+            this->signs[pivotRow - 1] = this->signs[pivotRow];
+
+            bool outcome = randomBit();
+            std::copy(p.xs.begin(), p.xs.end(), X(pivotRow));
+            std::copy(p.zs.begin(), p.zs.end(), Z(pivotRow));
+            this->signs[pivotRow] = p.sign ^ outcome;
+            return outcome;
+        }
+    };
+
+} // namespace Quantum
+} // namespace Microsoft
@@ -0,0 +1,81 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+// Measures how fast the state simulator applies a quantum Fourier transform and a random circuit, with and without
+// cache blocking. The throughput is given as the memory bandwidth that applying each gate in a separate pass over the
+// state vector would have needed, so that blocked runs can exceed the actual bandwidth of the machine.
+//
+// Usage: BlockingBenchmark [numQubits = 24] [numThreads = 0 (all hardware threads)]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "StateSimulator.hpp"
+
+using namespace Microsoft::Quantum;
+
+static void QuantumFourierTransform(StateSimulator<double>& sim, std::vector<Qubit>& qubits, std::size_t& numGates)
+{
+    int n = qubits.size();
+    for (int i = n - 1; i >= 0; i--) {
+        sim.H(qubits[i]);
+        numGates++;
+        for (int j = i - 1; j >= 0; j--) {
+            sim.ControlledR(1, &qubits[j], PauliId_Z, qubits[i], M_PI / std::pow(2.0, i - j));
+            numGates++;
+        }
+    }
+}
+
+static void RandomCircuit(StateSimulator<double>& sim, std::vector<Qubit>& qubits, std::size_t& numGates)
+{
+    std::mt19937 rng(7);
+    int n = qubits.size();
+    for (int k = 0; k < 20 * n; k++) {
+        int a = rng() % n, b = rng() % n;
+        if (rng() % 2) {
+            sim.H(qubits[a]);
+            sim.T(qubits[a]);
+            numGates += 2;
+        } else if (a != b) {
+            sim.ControlledX(1, &qubits[a], qubits[b]);
+            numGates++;
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int numQubits = argc > 1 ? std::atoi(argv[1]) : 24;
+    unsigned numThreads = argc > 2 ? std::atoi(argv[2]) : 0;
+
+    using Circuit = void (*)(StateSimulator<double>&, std::vector<Qubit>&, std::size_t&);
+    const std::pair<const char*, Circuit> circuits[] = {{"qft", QuantumFourierTransform}, {"random", RandomCircuit}};
+    for (auto [name, circuit] : circuits) {
+        for (std::size_t cacheBlockBytes : {std::size_t(0), StateSimulatorSettings().cacheBlockBytes}) {
+            StateSimulatorSettings settings;
+            settings.numThreads = numThreads;
+            settings.cacheBlockBytes = cacheBlockBytes;
+            StateSimulator<double> sim(1, settings);
+            std::vector<Qubit> qubits;
+            for (int i = 0; i < numQubits; i++)
+                qubits.push_back(sim.AllocateQubit());
+
+            std::size_t numGates = 0;
+            auto start = std::chrono::steady_clock::now();
+            circuit(sim, qubits, numGates);
+            // Reading the state applies any gates still queued.
+            sim.GetState([](std::size_t, double, double) { return false; });
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            double bytesPerPass = 2.0 * sizeof(std::complex<double>) * std::pow(2.0, numQubits);
+            std::printf("%-6s %2d qubits, blocks of %7zu bytes: %6zu gates in %7.3f s, %7.1f GB/s\n", name, numQubits,
+                        cacheBlockBytes, numGates, seconds, numGates * bytesPerPass / seconds / 1e9);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,196 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <complex>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "StateSimulator.hpp"
+
+using namespace Microsoft::Quantum;
+using namespace std::complex_literals;
+
+
+///
+/// State inspection
+///
+
+template <typename Precision>
+void StateSimulator<Precision>::GetState(TGetStateCallback callback)
+{
+    Densify();
+    FlushGates();
+    for (std::size_t i = 0; i < this->stateVec.size(); i++)
+        if (!callback(i, this->stateVec[i].real(), this->stateVec[i].imag()))
+            break;
+}
+
+template <typename Precision>
+void StateSimulator<Precision>::DumpMachine(const void* location)
+{
+    // The state is always printed to the console, regardless of the location provided.
+    FlushGates();
+    std::cout << "# wave function for qubits (most significant first):";
+    for (auto q = this->computeRegister.rbegin(); q != this->computeRegister.rend(); ++q)
+        std::cout << " " << QubitToString(*q);
+    std::cout << "\n";
+    if (this->classical) {
+        // Only the one basis state, whose index may not fit into an integer.
+        std::cout << "|";
+        for (short b = this->numActiveQubits - 1; b >= 0; b--)
+            std::cout << (GetClassicalBit(b) ? '1' : '0');
+        std::cout << "⟩:\t" << this->classicalPhase.real() << (this->classicalPhase.imag() < 0 ? " - " : " + ")
+                  << std::abs(this->classicalPhase.imag()) << "i\n" << std::flush;
+        return;
+    }
+    for (std::size_t i = 0; i < this->stateVec.size(); i++)
+        std::cout << "|" << i << "⟩:\t" << this->stateVec[i].real()
+                  << (this->stateVec[i].imag() < 0 ? " - " : " + ") << std::abs(this->stateVec[i].imag()) << "i\n";
+    std::cout << std::flush;
+}
+
+template <typename Precision>
+void StateSimulator<Precision>::DumpRegister(const void* location, const QirArray* qubits)
+{
+    throw std::logic_error("operation_not_supported");
+}
+
+
+///
+/// Expectation values
+///
+
+template <typename Precision>
+double StateSimulator<Precision>::Expectation(long numTargets, PauliId paulis[], Qubit targets[])
+{
+    PauliTerm term = {std::vector<PauliId>(paulis, paulis + numTargets), std::vector<Qubit>(targets, targets + numTargets)};
+    return Expectations({term})[0];
+}
+
+template <typename Precision>
+std::vector<double> StateSimulator<Precision>::Expectations(const std::vector<PauliTerm>& terms)
+{
+    // On a basis state, Pauli strings that flip any qubit have expectation value 0, and all others ±1.
+    if (this->classical) {
+        std::vector<double> expectations;
+        for (const PauliTerm& term : terms) {
+            double expectation = 1;
+            for (std::size_t i = 0; i < term.targets.size(); i++) {
+                if (term.paulis[i] == PauliId_X || term.paulis[i] == PauliId_Y)
+                    expectation = 0;
+                else if (term.paulis[i] == PauliId_Z && GetClassicalBit(GetQubitIdx(term.targets[i])))
+                    expectation = -expectation;
+            }
+            expectations.push_back(expectation);
+        }
+        return expectations;
+    }
+
+    // A Pauli string maps each basis state to another one up to a phase, P|i⟩ = i^numY (-1)^|i & phaseMask| |i ^ flipMask⟩,
+    // so that ⟨Ψ|P|Ψ⟩ = Σ_i i^numY (-1)^|i & phaseMask| conj(Ψ[i ^ flipMask]) Ψ[i].
+    struct TermMasks
+    {
+        std::size_t flipMask = 0, phaseMask = 0;
+        std::complex<double> phase = 1;
+    };
+    std::vector<TermMasks> masks(terms.size());
+    std::size_t termsMask = 0;
+    for (std::size_t t = 0; t < terms.size(); t++) {
+        for (std::size_t i = 0; i < terms[t].targets.size(); i++) {
+            std::size_t mask = GetQubitMask(terms[t].targets[i]);
+            if (terms[t].paulis[i] == PauliId_X || terms[t].paulis[i] == PauliId_Y)
+                masks[t].flipMask |= mask;
+            if (terms[t].paulis[i] == PauliId_Z || terms[t].paulis[i] == PauliId_Y)
+                masks[t].phaseMask |= mask;
+            if (terms[t].paulis[i] == PauliId_Y)
+                masks[t].phase *= 1i;
+        }
+        termsMask |= masks[t].flipMask | masks[t].phaseMask;
+    }
+    CheckNotMeasured(termsMask);
+    FlushGates();
+
+    // The last entry sums up the norm of the state vector, which the expectation values are divided by, so that
+    // rounding errors in the norm don't skew them.
+    struct TermSums
+    {
+        std::vector<double> sums;
+
+        TermSums& operator+=(const TermSums& other)
+        {
+            if (this->sums.empty())
+                this->sums = other.sums;
+            else
+                for (std::size_t t = 0; t < other.sums.size(); t++)
+                    this->sums[t] += other.sums[t];
+            return *this;
+        }
+    };
+    const Amplitude* amps = this->stateVec.data();
+    TermSums total = this->pool->ParallelSum<TermSums>(this->stateVec.size(), [&](std::size_t begin, std::size_t end) {
+        TermSums partial = {std::vector<double>(masks.size() + 1, 0.0)};
+        for (std::size_t i = begin; i < end; i++) {
+            std::complex<double> amp = amps[i];
+            partial.sums.back() += std::norm(amp);
+            for (std::size_t t = 0; t < masks.size(); t++) {
+                // Only the real part is needed, since the imaginary parts of i and i ^ flipMask cancel out.
+                double overlap = (masks[t].phase * std::conj(std::complex<double>(amps[i ^ masks[t].flipMask])) * amp).real();
+                partial.sums[t] += std::bitset<64>(i & masks[t].phaseMask).count() % 2 ? -overlap : overlap;
+            }
+        }
+        return partial;
+    });
+
+    std::vector<double> expectations(masks.size());
+    for (std::size_t t = 0; t < masks.size(); t++)
+        expectations[t] = total.sums[t] / total.sums.back();
+    return expectations;
+}
+
+
+///
+/// Assertions
+///
+
+template <typename Precision>
+bool StateSimulator<Precision>::Assert(long numTargets, PauliId* bases, Qubit* targets, Result result, const char* failureMessage)
+{
+    // Asserts that measuring the Pauli string would give the result with certainty, up to rounding errors.
+    double probabilityOfZero = (result == UseZero()) ? 1.0 : 0.0;
+    double precision = std::max(1e-10, 100 * double(std::numeric_limits<Precision>::epsilon()));
+    return AssertProbability(numTargets, bases, targets, probabilityOfZero, precision, failureMessage);
+}
+
+template <typename Precision>
+bool StateSimulator<Precision>::AssertProbability(long numTargets, PauliId bases[], Qubit targets[], double probabilityOfZero, double precision, const char* failureMessage)
+{
+    // The outcome Zero projects onto the +1 eigenspace of P, so that p(Zero) = (1 + ⟨Ψ|P|Ψ⟩) / 2.
+    double actualProbabilityOfZero = (1.0 + Expectation(numTargets, bases, targets)) / 2.0;
+    return std::abs(actualProbabilityOfZero - probabilityOfZero) < precision;
+}
+
+
+// The class itself is instantiated in RuntimeManagement.cpp, which only covers the members defined there.
+#define INSTANTIATE_DIAGNOSTICS(Precision) \
+    template void StateSimulator<Precision>::GetState(TGetStateCallback); \
+    template void StateSimulator<Precision>::DumpMachine(const void*); \
+    template void StateSimulator<Precision>::DumpRegister(const void*, const QirArray*); \
+    template double StateSimulator<Precision>::Expectation(long, PauliId[], Qubit[]); \
+    template std::vector<double> StateSimulator<Precision>::Expectations(const std::vector<PauliTerm>&); \
+    template bool StateSimulator<Precision>::Assert(long, PauliId*, Qubit*, Result, const char*); \
+    template bool StateSimulator<Precision>::AssertProbability(long, PauliId[], Qubit[], double, double, const char*);
+
+namespace Microsoft
+{
+namespace Quantum
+{
+    INSTANTIATE_DIAGNOSTICS(float)
+    INSTANTIATE_DIAGNOSTICS(double)
+
+} // namespace Quantum
+} // namespace Microsoft
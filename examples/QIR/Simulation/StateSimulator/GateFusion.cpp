@@ -0,0 +1,420 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <algorithm>
+#include <bitset>
+#include <complex>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "StateSimulator.hpp"
+
+using namespace Microsoft::Quantum;
+
+static std::size_t CountQubits(std::size_t qubitMask)
+{
+    return std::bitset<64>(qubitMask).count();
+}
+
+// Maps the bits of a local index over the qubits in `subMask` to the corresponding bits of a local index
+// over the qubits in `fullMask`, where `subMask` is a subset of `fullMask`.
+static std::size_t ExpandIndex(std::size_t local, std::size_t subMask, std::size_t fullMask)
+{
+    std::size_t expanded = 0;
+    for (std::size_t mask = 1, subBit = 1, fullBit = 1; mask != 0 && mask <= fullMask; mask <<= 1) {
+        if (!(fullMask & mask))
+            continue;
+        if (subMask & mask) {
+            if (local & subBit)
+                expanded |= fullBit;
+            subBit <<= 1;
+        }
+        fullBit <<= 1;
+    }
+    return expanded;
+}
+
+// Builds the matrix of a (controlled) single-qubit gate over the qubits in `qubitMask`.
+template <typename Precision>
+static Operator GateMatrix(const GateKernelArgs<Precision>& gate, std::size_t qubitMask)
+{
+    std::size_t dim = std::size_t(1) << CountQubits(qubitMask);
+    std::size_t target = 0, controls = 0;
+    for (std::size_t mask = 1, bit = 1; mask != 0 && mask <= qubitMask; mask <<= 1) {
+        if (!(qubitMask & mask))
+            continue;
+        if (gate.targetMask == mask)
+            target = bit;
+        if (gate.controlMask & mask)
+            controls |= bit;
+        bit <<= 1;
+    }
+
+    Operator matrix = Operator::Identity(dim, dim);
+    for (std::size_t col = 0; col < dim; col++) {
+        if ((col & controls) != controls)
+            continue;
+        std::size_t colBit = (col & target) ? 1 : 0;
+        matrix(col & ~target, col) = gate.gate[0][colBit];
+        matrix(col | target, col) = gate.gate[1][colBit];
+    }
+    return matrix;
+}
+
+// Extends a matrix over the qubits in `subMask` to the qubits in `fullMask`, acting as the identity on the others.
+static Operator EmbedMatrix(const Operator& matrix, std::size_t subMask, std::size_t fullMask)
+{
+    if (subMask == fullMask)
+        return matrix;
+
+    std::size_t dim = std::size_t(1) << CountQubits(fullMask);
+    std::size_t subDim = matrix.rows();
+    std::size_t subBits = ExpandIndex(subDim - 1, subMask, fullMask);
+
+    Operator embedded = Operator::Zero(dim, dim);
+    for (std::size_t rest = 0; rest < dim; rest++) {
+        if (rest & subBits)
+            continue;
+        for (std::size_t col = 0; col < subDim; col++)
+            for (std::size_t row = 0; row < subDim; row++)
+                embedded(ExpandIndex(row, subMask, fullMask) | rest, ExpandIndex(col, subMask, fullMask) | rest) = matrix(row, col);
+    }
+    return embedded;
+}
+
+
+///
+/// Gate fusion
+///
+
+template <typename Precision>
+void StateSimulator<Precision>::QueueGate(GateKernelArgs<Precision> args, long numControls, Qubit controls[], Qubit target)
+{
+    args.targetMask = GetQubitMask(target);
+    args.controlMask = 0;
+    for (long i = 0; i < numControls; i++)
+        args.controlMask |= GetQubitMask(controls[i]);
+
+    std::size_t gateMask = args.targetMask | args.controlMask;
+    CheckNotMeasured(gateMask);
+    if (CountQubits(gateMask) > this->fusionWidth) {
+        RetireGates(gateMask);
+        this->gateBatch.push_back({gateMask, Operator(), args, 1});
+        if (++this->numQueuedGates >= this->fusionDepth)
+            RunQueuedGates();
+        return;
+    }
+
+    // The new gate is fused with all queued gates it shares qubits with, as long as the result isn't too wide.
+    // Otherwise, those gates are applied first and the new gate starts a new entry in the queue.
+    std::size_t fusedMask = gateMask;
+    for (const FusedGate& fused : this->fusedGates)
+        if (fused.qubitMask & gateMask)
+            fusedMask |= fused.qubitMask;
+    if (CountQubits(fusedMask) > this->fusionWidth) {
+        RetireGates(gateMask);
+        fusedMask = gateMask;
+    }
+
+    FusedGate merged = {fusedMask, Operator(), args, 1};
+    for (auto it = this->fusedGates.begin(); it != this->fusedGates.end();) {
+        if (!(it->qubitMask & fusedMask)) {
+            ++it;
+            continue;
+        }
+        // Entries in the queue commute, so they can be merged in any order before the new gate.
+        Operator matrix = it->numGates == 1 ? GateMatrix(it->first, it->qubitMask) : it->matrix;
+        Operator embedded = EmbedMatrix(matrix, it->qubitMask, fusedMask);
+        merged.matrix = merged.numGates == 1 ? embedded : (embedded * merged.matrix).eval();
+        merged.numGates += it->numGates;
+        it = this->fusedGates.erase(it);
+    }
+    if (merged.numGates > 1)
+        merged.matrix = EmbedMatrix(GateMatrix(args, gateMask), gateMask, fusedMask) * merged.matrix;
+    this->fusedGates.push_back(std::move(merged));
+
+    if (++this->numQueuedGates >= this->fusionDepth)
+        RunQueuedGates();
+}
+
+template <typename Precision>
+void StateSimulator<Precision>::RunQueuedGates()
+{
+    // Unlike other callers of FlushGates, nothing here holds on to masks computed from the qubit positions,
+    // so the batch is free to move qubits into the block.
+    RetireGates(~std::size_t(0));
+    RunGateBatch(/*remap=*/true);
+}
+
+template <typename Precision>
+void StateSimulator<Precision>::FlushGates(std::size_t qubitMask)
+{
+    RetireGates(qubitMask);
+    RunGateBatch();
+}
+
+template <typename Precision>
+void StateSimulator<Precision>::RetireGates(std::size_t qubitMask)
+{
+    for (auto it = this->fusedGates.begin(); it != this->fusedGates.end();) {
+        if (!(it->qubitMask & qubitMask)) {
+            ++it;
+            continue;
+        }
+        this->gateBatch.push_back(std::move(*it));
+        it = this->fusedGates.erase(it);
+    }
+}
+
+template <typename Precision>
+void StateSimulator<Precision>::RunFusedGate(const FusedGate& fused)
+{
+    if (fused.numGates == 1) {
+        RunGateKernel(fused.first);
+        return;
+    }
+
+    PreparedGate prepared = PrepareGate(fused, ~std::size_t(0));
+    Amplitude* amps = this->stateVec.data();
+    this->pool->ParallelFor(this->stateVec.size() >> prepared.fixedBits.size(), [&](std::size_t begin, std::size_t end) {
+        RunPreparedGate(prepared, amps, begin, end);
+    });
+}
+
+template <typename Precision>
+typename StateSimulator<Precision>::PreparedGate StateSimulator<Precision>::PrepareGate(const FusedGate& fused, std::size_t blockMask)
+{
+    PreparedGate prepared = {};
+    prepared.isMatrix = false;
+    std::size_t qubitMask;
+    if (fused.numGates == 1 || fused.matrix.rows() == 2) {
+        prepared.args = fused.first;
+        if (fused.numGates > 1) {
+            // Still a single-qubit gate, which keeps the diagonal and permutation fast paths where possible.
+            const Operator& matrix = fused.matrix;
+            prepared.args = MakeKernelArgs(GateKernelType_General, matrix);
+            if (matrix(0,1) == 0.0 && matrix(1,0) == 0.0)
+                prepared.args.type = GateKernelType_Diagonal;
+            else if (matrix(0,0) == 0.0 && matrix(1,1) == 0.0)
+                prepared.args.type = GateKernelType_Permutation;
+            prepared.args.targetMask = fused.qubitMask;
+            prepared.args.controlMask = 0;
+        }
+        prepared.outerControls = prepared.args.controlMask & ~blockMask;
+        prepared.args.controlMask &= blockMask;
+        qubitMask = prepared.args.targetMask | prepared.args.controlMask;
+    } else {
+        // The matrix is multiplied out in double precision and only rounded to the simulator's precision here.
+        prepared.isMatrix = true;
+        prepared.matrix = fused.matrix.template cast<Amplitude>();
+        prepared.outerControls = 0;
+        qubitMask = fused.qubitMask;
+    }
+    for (std::size_t mask = 1; mask != 0 && mask <= qubitMask; mask <<= 1)
+        if (qubitMask & mask)
+            prepared.fixedBits.push_back(mask);
+    return prepared;
+}
+
+template <typename Precision>
+void StateSimulator<Precision>::RunPreparedGate(const PreparedGate& prepared, Amplitude* amps, std::size_t begin, std::size_t end)
+{
+    if (prepared.isMatrix) {
+        MatrixKernelArgs<Precision> args = {prepared.matrix.data(), amps, prepared.fixedBits.data(), prepared.fixedBits.size()};
+        ApplyMatrixKernel(args, begin, end);
+        return;
+    }
+    GateKernelArgs<Precision> args = prepared.args;
+    args.amps = amps;
+    args.fixedBits = prepared.fixedBits.data();
+    args.numFixedBits = prepared.fixedBits.size();
+    ApplyGateKernel(args, begin, end);
+}
+
+
+///
+/// Cache blocking
+///
+
+// Returns whether the entry only mixes amplitudes whose indices differ in the bits of `blockMask`.
+// Controls may lie outside of it, since they are the same for all amplitudes of a block.
+template <typename FusedGate>
+static bool IsBlockLocal(const FusedGate& fused, std::size_t blockMask)
+{
+    std::size_t mixedMask = fused.numGates == 1 ? fused.first.targetMask : fused.qubitMask;
+    return (mixedMask & ~blockMask) == 0;
+}
+
+template <typename Precision>
+void StateSimulator<Precision>::RunGateBatch(bool remap)
+{
+    if (this->gateBatch.empty())
+        return;
+
+    // Once the state vector no longer fits into a block, every entry applied on its own means a pass through memory.
+    // Blocks are handed out to threads whole, so blocking is only used while there is at least one block per thread.
+    bool blocked = this->blockQubits > 0 && unsigned(this->numActiveQubits) > this->blockQubits
+        && (this->stateVec.size() >> this->blockQubits) >= this->pool->Size();
+    if (blocked && remap)
+        RemapForBlocking();
+
+    std::size_t blockMask = (std::size_t(1) << this->blockQubits) - 1;
+    for (std::size_t first = 0, last; first < this->gateBatch.size(); first = last) {
+        last = first;
+        if (blocked) {
+            // Pull each local entry forward past the entries skipped so far, as long as it commutes with all of them,
+            // i.e. shares no qubits with any of them.
+            std::size_t skippedMask = 0;
+            for (std::size_t n = first; n < this->gateBatch.size(); n++) {
+                if (IsBlockLocal(this->gateBatch[n], blockMask) && !(this->gateBatch[n].qubitMask & skippedMask)) {
+                    std::rotate(this->gateBatch.begin() + last, this->gateBatch.begin() + n, this->gateBatch.begin() + n + 1);
+                    last++;
+                }
+                else
+                    skippedMask |= this->gateBatch[n].qubitMask;
+            }
+        }
+        if (last <= first + 1) {
+            last = first + 1;
+            RunFusedGate(this->gateBatch[first]);
+        }
+        else
+            RunBlockedGates(first, last);
+    }
+
+    for (const FusedGate& fused : this->gateBatch) {
+        this->numQueuedGates -= fused.numGates;
+        this->numSweepsSaved += fused.numGates - 1;
+    }
+    this->gateBatch.clear();
+}
+
+template <typename Precision>
+void StateSimulator<Precision>::RunBlockedGates(std::size_t first, std::size_t last)
+{
+    // Each thread applies all entries to one block before moving on to the next, so that the block stays in its cache.
+    // The loop is over blocks, so the pool is told how many amplitudes each one holds to split it between threads.
+    std::size_t blockMask = (std::size_t(1) << this->blockQubits) - 1;
+    std::vector<PreparedGate> prepared;
+    for (std::size_t n = first; n < last; n++)
+        prepared.push_back(PrepareGate(this->gateBatch[n], blockMask));
+
+    Amplitude* amps = this->stateVec.data();
+    this->pool->ParallelFor(this->stateVec.size() >> this->blockQubits, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t block = begin; block < end; block++) {
+            std::size_t offset = block << this->blockQubits;
+            if (block + 1 < end)
+                this->stateVec.Prefetch(offset + blockMask + 1, blockMask + 1);
+            for (const PreparedGate& gate : prepared)
+                if ((offset & gate.outerControls) == gate.outerControls)
+                    RunPreparedGate(gate, amps + offset, 0, (blockMask + 1) >> gate.fixedBits.size());
+        }
+    }, blockMask + 1);
+    this->numSweepsSaved += last - first - 1;
+}
+
+// Exchanges the bits `lowMask` and `highMask` of the given mask.
+static std::size_t SwapBits(std::size_t mask, std::size_t lowMask, std::size_t highMask)
+{
+    bool low = mask & lowMask, high = mask & highMask;
+    return (low == high) ? mask : mask ^ lowMask ^ highMask;
+}
+
+template <typename Precision>
+void StateSimulator<Precision>::RemapForBlocking()
+{
+    // Swapping a qubit into the block takes about one pass over the state vector, and saves one pass for each entry
+    // that then only acts within blocks, at the cost of the entries on the qubit it swaps places with.
+    std::vector<std::size_t> uses(this->numActiveQubits, 0);
+    for (const FusedGate& fused : this->gateBatch) {
+        std::size_t mixedMask = fused.numGates == 1 ? fused.first.targetMask : fused.qubitMask;
+        for (short b = 0; b < this->numActiveQubits; b++)
+            if (mixedMask & (std::size_t(1) << b))
+                uses[b]++;
+    }
+
+    std::vector<short> inner, outer;
+    for (short b = 0; b < this->numActiveQubits; b++)
+        (b < short(this->blockQubits) ? inner : outer).push_back(b);
+    std::sort(inner.begin(), inner.end(), [&](short a, short b) { return uses[a] < uses[b]; });
+    std::sort(outer.begin(), outer.end(), [&](short a, short b) { return uses[a] > uses[b]; });
+    for (std::size_t n = 0; n < inner.size() && n < outer.size(); n++) {
+        if (uses[outer[n]] < uses[inner[n]] + 2)
+            break;
+        SwapQubitPositions(inner[n], outer[n]);
+    }
+}
+
+template <typename Precision>
+void StateSimulator<Precision>::SwapQubitPositions(short low, short high)
+{
+    // Exchanging the bits of two qubits swaps the amplitudes whose indices differ in them.
+    std::size_t lowMask = std::size_t(1) << low, highMask = std::size_t(1) << high;
+    Amplitude* amps = this->stateVec.data();
+    this->pool->ParallelFor(this->stateVec.size() >> 2, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t k = begin; k < end; k++) {
+            std::size_t i = ((k & ~(lowMask - 1)) << 1) | (k & (lowMask - 1));
+            i = ((i & ~(highMask - 1)) << 1) | (i & (highMask - 1));
+            std::swap(amps[i | lowMask], amps[i | highMask]);
+        }
+    });
+
+    Qubit lowQubit = this->computeRegister[low], highQubit = this->computeRegister[high];
+    this->computeRegister[low] = highQubit;
+    this->computeRegister[high] = lowQubit;
+    this->qubitPositions[this->qbm->GetQubitId(highQubit)] = low;
+    this->qubitPositions[this->qbm->GetQubitId(lowQubit)] = high;
+    this->measuredMask = SwapBits(this->measuredMask, lowMask, highMask);
+
+    // The batch still refers to the old positions. Matrices are indexed by the order of their qubits' bits,
+    // which may change as well.
+    for (FusedGate& fused : this->gateBatch) {
+        std::size_t qubitMask = SwapBits(fused.qubitMask, lowMask, highMask);
+        if (fused.numGates > 1 && (fused.qubitMask & (lowMask | highMask))) {
+            std::vector<std::size_t> newBits;
+            for (std::size_t mask = 1; mask != 0 && mask <= fused.qubitMask; mask <<= 1)
+                if (fused.qubitMask & mask)
+                    newBits.push_back(std::size_t(1) << CountQubits(qubitMask & (SwapBits(mask, lowMask, highMask) - 1)));
+            auto permute = [&](std::size_t index) {
+                std::size_t permuted = 0;
+                for (std::size_t j = 0; j < newBits.size(); j++)
+                    if (index & (std::size_t(1) << j))
+                        permuted |= newBits[j];
+                return permuted;
+            };
+            Operator matrix(fused.matrix.rows(), fused.matrix.cols());
+            for (Eigen::Index col = 0; col < matrix.cols(); col++)
+                for (Eigen::Index row = 0; row < matrix.rows(); row++)
+                    matrix(permute(row), permute(col)) = fused.matrix(row, col);
+            fused.matrix = std::move(matrix);
+        }
+        fused.qubitMask = qubitMask;
+        fused.first.targetMask = SwapBits(fused.first.targetMask, lowMask, highMask);
+        fused.first.controlMask = SwapBits(fused.first.controlMask, lowMask, highMask);
+    }
+}
+
+// The class itself is instantiated in RuntimeManagement.cpp, which only covers the members defined there.
+#define INSTANTIATE_GATE_FUSION(Precision) \
+    template void StateSimulator<Precision>::QueueGate(GateKernelArgs<Precision>, long, Qubit[], Qubit); \
+    template void StateSimulator<Precision>::RunQueuedGates(); \
+    template void StateSimulator<Precision>::FlushGates(std::size_t); \
+    template void StateSimulator<Precision>::RetireGates(std::size_t); \
+    template void StateSimulator<Precision>::RunFusedGate(const FusedGate&); \
+    template StateSimulator<Precision>::PreparedGate StateSimulator<Precision>::PrepareGate(const FusedGate&, std::size_t); \
+    template void StateSimulator<Precision>::RunPreparedGate(const PreparedGate&, Amplitude*, std::size_t, std::size_t); \
+    template void StateSimulator<Precision>::RunGateBatch(bool); \
+    template void StateSimulator<Precision>::RunBlockedGates(std::size_t, std::size_t); \
+    template void StateSimulator<Precision>::RemapForBlocking(); \
+    template void StateSimulator<Precision>::SwapQubitPositions(short, short);
+
+namespace Microsoft
+{
+namespace Quantum
+{
+    INSTANTIATE_GATE_FUSION(float)
+    INSTANTIATE_GATE_FUSION(double)
+
+} // namespace Quantum
+} // namespace Microsoft
@@ -0,0 +1,336 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <bitset>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#include "GateKernels.hpp"
+
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+#define VECTOR_KERNELS
+#include <immintrin.h>
+#endif
+
+using namespace Microsoft::Quantum;
+
+template <typename Precision>
+static inline std::size_t PairIndex(const GateKernelArgs<Precision>& args, std::size_t k)
+{
+    // Insert a zero at each fixed bit, then set the control bits.
+    for (std::size_t n = 0; n < args.numFixedBits; n++) {
+        std::size_t mask = args.fixedBits[n];
+        k = ((k & ~(mask - 1)) << 1) | (k & (mask - 1));
+    }
+    return k | args.controlMask;
+}
+
+template <typename Precision>
+static inline void ApplyPair(const GateKernelArgs<Precision>& args, std::size_t i)
+{
+    std::complex<Precision> a0 = args.amps[i], a1 = args.amps[i | args.targetMask];
+    args.amps[i]                   = args.gate[0][0]*a0 + args.gate[0][1]*a1;
+    args.amps[i | args.targetMask] = args.gate[1][0]*a0 + args.gate[1][1]*a1;
+}
+
+template <typename Precision>
+static void ApplyGateScalar(const GateKernelArgs<Precision>& args, std::size_t begin, std::size_t end)
+{
+    for (std::size_t k = begin; k < end; k++)
+        ApplyPair(args, PairIndex(args, k));
+}
+
+template <typename Precision>
+static void ApplyDiagonal(const GateKernelArgs<Precision>& args, std::size_t begin, std::size_t end)
+{
+    // Most diagonal gates (Z, S, T, ...) leave the |0⟩ half untouched, in which case it is not even read.
+    std::complex<Precision> phase0 = args.gate[0][0], phase1 = args.gate[1][1];
+    if (phase0 == Precision(1)) {
+        for (std::size_t k = begin; k < end; k++)
+            args.amps[PairIndex(args, k) | args.targetMask] *= phase1;
+    } else {
+        for (std::size_t k = begin; k < end; k++) {
+            std::size_t i = PairIndex(args, k);
+            args.amps[i] *= phase0;
+            args.amps[i | args.targetMask] *= phase1;
+        }
+    }
+}
+
+template <typename Precision>
+static void ApplyPermutation(const GateKernelArgs<Precision>& args, std::size_t begin, std::size_t end)
+{
+    std::complex<Precision> phase01 = args.gate[0][1], phase10 = args.gate[1][0];
+    if (phase01 == Precision(1) && phase10 == Precision(1)) {
+        for (std::size_t k = begin; k < end; k++) {
+            std::size_t i = PairIndex(args, k);
+            std::swap(args.amps[i], args.amps[i | args.targetMask]);
+        }
+    } else {
+        for (std::size_t k = begin; k < end; k++) {
+            std::size_t i = PairIndex(args, k);
+            std::complex<Precision> a0 = args.amps[i];
+            args.amps[i] = phase01 * args.amps[i | args.targetMask];
+            args.amps[i | args.targetMask] = phase10 * a0;
+        }
+    }
+}
+
+template <typename Precision>
+void Microsoft::Quantum::ApplyMatrixKernel(const MatrixKernelArgs<Precision>& args, std::size_t begin, std::size_t end)
+{
+    std::size_t dim = std::size_t(1) << args.numFixedBits;
+    std::size_t offsets[std::size_t(1) << MatrixKernelMaxQubits];
+    for (std::size_t x = 0; x < dim; x++) {
+        offsets[x] = 0;
+        for (std::size_t j = 0; j < args.numFixedBits; j++)
+            if (x & (std::size_t(1) << j))
+                offsets[x] |= args.fixedBits[j];
+    }
+
+    std::complex<Precision> in[std::size_t(1) << MatrixKernelMaxQubits];
+    for (std::size_t k = begin; k < end; k++) {
+        std::size_t base = k;
+        for (std::size_t n = 0; n < args.numFixedBits; n++) {
+            std::size_t mask = args.fixedBits[n];
+            base = ((base & ~(mask - 1)) << 1) | (base & (mask - 1));
+        }
+
+        for (std::size_t x = 0; x < dim; x++)
+            in[x] = args.amps[base | offsets[x]];
+        for (std::size_t y = 0; y < dim; y++) {
+            std::complex<Precision> out = 0;
+            for (std::size_t x = 0; x < dim; x++)
+                out += args.matrix[x*dim + y] * in[x];
+            args.amps[base | offsets[y]] = out;
+        }
+    }
+}
+
+template <typename Precision>
+void Microsoft::Quantum::ApplyPauliKernel(const PauliKernelArgs<Precision>& args, std::size_t begin, std::size_t end)
+{
+    auto sign = [&args](std::size_t i) {
+        return std::bitset<64>(i & args.phaseMask).count() % 2 == 1 ? Precision(-1) : Precision(1);
+    };
+    auto baseIndex = [&args](std::size_t k) {
+        for (std::size_t n = 0; n < args.numFixedBits; n++) {
+            std::size_t mask = args.fixedBits[n];
+            k = ((k & ~(mask - 1)) << 1) | (k & (mask - 1));
+        }
+        return k | args.controlMask;
+    };
+
+    // i sin θ · i^{#Y}, the factor in front of P.
+    static const std::complex<Precision> powersOfI[4] = {1, {0, 1}, -1, {0, -1}};
+    Precision c = std::cos(args.theta);
+    std::complex<Precision> s = std::complex<Precision>(0, std::sin(args.theta)) * powersOfI[args.numY % 4];
+
+    if (args.flipMask == 0) {
+        // P only contains Z and I, so the update is diagonal: e^{±iθ} depending on the parity.
+        std::complex<Precision> even = c + s, odd = c - s;
+        for (std::size_t k = begin; k < end; k++) {
+            std::size_t i = baseIndex(k);
+            args.amps[i] *= sign(i) > 0 ? even : odd;
+        }
+        return;
+    }
+
+    for (std::size_t k = begin; k < end; k++) {
+        std::size_t i = baseIndex(k), j = i ^ args.flipMask;
+        std::complex<Precision> a0 = args.amps[i], a1 = args.amps[j];
+        args.amps[i] = c*a0 + s*sign(j)*a1;
+        args.amps[j] = c*a1 + s*sign(i)*a0;
+    }
+}
+
+
+///
+/// Vectorized kernels
+///
+
+#ifdef VECTOR_KERNELS
+
+// Multiplies the interleaved complex numbers in a and b element-wise.
+__attribute__((target("avx2,fma")))
+static inline __m256d MulComplex(__m256d a, __m256d b)
+{
+    __m256d bRe = _mm256_movedup_pd(b);                  // [b0.re, b0.re, b1.re, b1.re]
+    __m256d bIm = _mm256_permute_pd(b, 0xF);             // [b0.im, b0.im, b1.im, b1.im]
+    __m256d aSwapped = _mm256_permute_pd(a, 0x5);        // [a0.im, a0.re, a1.im, a1.re]
+    return _mm256_fmaddsub_pd(a, bRe, _mm256_mul_pd(aSwapped, bIm));
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256d Broadcast(std::complex<double> c)
+{
+    return _mm256_setr_pd(c.real(), c.imag(), c.real(), c.imag());
+}
+
+__attribute__((target("avx2,fma")))
+static void ApplyGateAvx2(const GateKernelArgs<double>& args, std::size_t begin, std::size_t end)
+{
+    double* amps = reinterpret_cast<double*>(args.amps);
+
+    if (args.targetMask == 1) {
+        // Low-qubit case: both amplitudes of a pair sit next to each other and fit in one register.
+        __m256d col0 = _mm256_setr_pd(args.gate[0][0].real(), args.gate[0][0].imag(),
+                                      args.gate[1][0].real(), args.gate[1][0].imag());
+        __m256d col1 = _mm256_setr_pd(args.gate[0][1].real(), args.gate[0][1].imag(),
+                                      args.gate[1][1].real(), args.gate[1][1].imag());
+        for (std::size_t k = begin; k < end; k++) {
+            double* p = amps + 2*PairIndex(args, k);
+            __m256d pair = _mm256_loadu_pd(p);
+            __m256d a0 = _mm256_permute2f128_pd(pair, pair, 0x00);
+            __m256d a1 = _mm256_permute2f128_pd(pair, pair, 0x11);
+            _mm256_storeu_pd(p, _mm256_add_pd(MulComplex(col0, a0), MulComplex(col1, a1)));
+        }
+        return;
+    }
+    if (args.fixedBits[0] == 1) {
+        // Controlled on the lowest bit, so neighbouring pairs are not adjacent in memory.
+        ApplyGateScalar(args, begin, end);
+        return;
+    }
+
+    // High-qubit case: pairs 2m and 2m+1 have adjacent indices, so two pairs are updated at once.
+    __m256d g00 = Broadcast(args.gate[0][0]), g01 = Broadcast(args.gate[0][1]);
+    __m256d g10 = Broadcast(args.gate[1][0]), g11 = Broadcast(args.gate[1][1]);
+    std::size_t k = begin;
+    if (k % 2 != 0 && k < end)
+        ApplyPair(args, PairIndex(args, k++));
+    for (; k + 1 < end; k += 2) {
+        std::size_t i = PairIndex(args, k);
+        double* p0 = amps + 2*i;
+        double* p1 = amps + 2*(i | args.targetMask);
+        __m256d a0 = _mm256_loadu_pd(p0), a1 = _mm256_loadu_pd(p1);
+        _mm256_storeu_pd(p0, _mm256_add_pd(MulComplex(g00, a0), MulComplex(g01, a1)));
+        _mm256_storeu_pd(p1, _mm256_add_pd(MulComplex(g10, a0), MulComplex(g11, a1)));
+    }
+    if (k < end)
+        ApplyPair(args, PairIndex(args, k));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512d MulComplex(__m512d a, __m512d b)
+{
+    __m512d bRe = _mm512_movedup_pd(b);
+    __m512d bIm = _mm512_permute_pd(b, 0xFF);
+    __m512d aSwapped = _mm512_permute_pd(a, 0x55);
+    return _mm512_fmaddsub_pd(a, bRe, _mm512_mul_pd(aSwapped, bIm));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512d Broadcast4(std::complex<double> c)
+{
+    return _mm512_setr_pd(c.real(), c.imag(), c.real(), c.imag(), c.real(), c.imag(), c.real(), c.imag());
+}
+
+__attribute__((target("avx512f,avx2,fma")))
+static void ApplyGateAvx512(const GateKernelArgs<double>& args, std::size_t begin, std::size_t end)
+{
+    if (args.fixedBits[0] < 4) {
+        // Fewer than four adjacent pairs, which the AVX2 kernel handles.
+        ApplyGateAvx2(args, begin, end);
+        return;
+    }
+
+    // High-qubit case: pairs 4m to 4m+3 have adjacent indices, so four pairs are updated at once.
+    double* amps = reinterpret_cast<double*>(args.amps);
+    __m512d g00 = Broadcast4(args.gate[0][0]), g01 = Broadcast4(args.gate[0][1]);
+    __m512d g10 = Broadcast4(args.gate[1][0]), g11 = Broadcast4(args.gate[1][1]);
+    std::size_t k = begin;
+    for (; k % 4 != 0 && k < end; k++)
+        ApplyPair(args, PairIndex(args, k));
+    for (; k + 3 < end; k += 4) {
+        std::size_t i = PairIndex(args, k);
+        double* p0 = amps + 2*i;
+        double* p1 = amps + 2*(i | args.targetMask);
+        __m512d a0 = _mm512_loadu_pd(p0), a1 = _mm512_loadu_pd(p1);
+        _mm512_storeu_pd(p0, _mm512_add_pd(MulComplex(g00, a0), MulComplex(g01, a1)));
+        _mm512_storeu_pd(p1, _mm512_add_pd(MulComplex(g10, a0), MulComplex(g11, a1)));
+    }
+    for (; k < end; k++)
+        ApplyPair(args, PairIndex(args, k));
+}
+
+#endif // VECTOR_KERNELS
+
+
+///
+/// Kernel selection
+///
+
+using GateKernel = void (*)(const GateKernelArgs<double>&, std::size_t, std::size_t);
+
+struct KernelChoice
+{
+    GateKernel kernel;
+    const char* name;
+};
+
+static KernelChoice SelectKernel()
+{
+    const char* requested = std::getenv("QIR_SIMULATOR_KERNEL");
+    auto allowed = [requested](const char* name) {
+        return requested == nullptr || std::strcmp(requested, name) == 0;
+    };
+
+#ifdef VECTOR_KERNELS
+    __builtin_cpu_init();
+    bool hasAvx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if (hasAvx2 && __builtin_cpu_supports("avx512f") && allowed("avx512"))
+        return {ApplyGateAvx512, "avx512"};
+    if (hasAvx2 && allowed("avx2"))
+        return {ApplyGateAvx2, "avx2"};
+#endif
+
+    return {ApplyGateScalar, "scalar"};
+}
+
+static const KernelChoice selectedKernel = SelectKernel();
+
+template <typename Precision>
+void Microsoft::Quantum::ApplyGateKernel(const GateKernelArgs<Precision>& args, std::size_t begin, std::size_t end)
+{
+    switch (args.type) {
+        case GateKernelType_Diagonal:
+            ApplyDiagonal(args, begin, end);
+            break;
+        case GateKernelType_Permutation:
+            ApplyPermutation(args, begin, end);
+            break;
+        default:
+            if constexpr (std::is_same<Precision, double>::value)
+                selectedKernel.kernel(args, begin, end);
+            else
+                ApplyGateScalar(args, begin, end);
+    }
+}
+
+const char* Microsoft::Quantum::GateKernelName()
+{
+    return selectedKernel.name;
+}
+
+
+///
+/// Explicit instantiations
+///
+
+namespace Microsoft
+{
+namespace Quantum
+{
+    template void ApplyGateKernel(const GateKernelArgs<float>&, std::size_t, std::size_t);
+    template void ApplyGateKernel(const GateKernelArgs<double>&, std::size_t, std::size_t);
+    template void ApplyMatrixKernel(const MatrixKernelArgs<float>&, std::size_t, std::size_t);
+    template void ApplyMatrixKernel(const MatrixKernelArgs<double>&, std::size_t, std::size_t);
+    template void ApplyPauliKernel(const PauliKernelArgs<float>&, std::size_t, std::size_t);
+    template void ApplyPauliKernel(const PauliKernelArgs<double>&, std::size_t, std::size_t);
+
+} // namespace Quantum
+} // namespace Microsoft
@@ -0,0 +1,94 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <complex>
+#include <cstddef>
+
+namespace Microsoft
+{
+namespace Quantum
+{
+    enum GateKernelType
+    {
+        GateKernelType_General,     // arbitrary 2x2 gate
+        GateKernelType_Diagonal,    // only gate[0][0] and gate[1][1] are non-zero
+        GateKernelType_Permutation  // only gate[0][1] and gate[1][0] are non-zero
+    };
+
+    // All kernels are available for amplitudes of type std::complex<Precision>, with Precision float or double.
+
+    // Describes the in-place update of the amplitude pairs (i, i | targetMask) whose control bits are all set
+    // by a 2x2 gate. The pairs are numbered by counting over the bits of the state index not in `fixedBits`.
+    template <typename Precision>
+    struct GateKernelArgs
+    {
+        GateKernelType type;
+        std::complex<Precision> gate[2][2];
+        std::complex<Precision>* amps;
+        std::size_t targetMask;
+        std::size_t controlMask;
+
+        // Masks of the target and control bits, sorted in ascending order.
+        const std::size_t* fixedBits;
+        std::size_t numFixedBits;
+    };
+
+    // Applies the update to the pairs numbered [begin, end).
+    // Diagonal and permutation gates use dedicated loops that touch each amplitude at most once and skip
+    // amplitudes that are left unchanged. For general gates, the implementation is picked at startup based
+    // on the vector extensions supported by the CPU, and can be overridden with the QIR_SIMULATOR_KERNEL
+    // environment variable ("scalar", "avx2", "avx512"). Vectorized kernels only exist for double precision.
+    template <typename Precision>
+    void ApplyGateKernel(const GateKernelArgs<Precision>& args, std::size_t begin, std::size_t end);
+
+    // Largest number of qubits supported by the matrix kernel.
+    constexpr std::size_t MatrixKernelMaxQubits = 6;
+
+    // Describes the in-place update of the groups of 2^k amplitudes spanned by k qubits with a 2^k x 2^k matrix.
+    // The groups are numbered by counting over the bits of the state index not in `fixedBits`.
+    template <typename Precision>
+    struct MatrixKernelArgs
+    {
+        // Column-major matrix, where bit j of the matrix index corresponds to the state index bit fixedBits[j].
+        const std::complex<Precision>* matrix;
+        std::complex<Precision>* amps;
+
+        // Masks of the qubits acted on, sorted in ascending order.
+        const std::size_t* fixedBits;
+        std::size_t numFixedBits;
+    };
+
+    // Applies the update to the groups numbered [begin, end).
+    template <typename Precision>
+    void ApplyMatrixKernel(const MatrixKernelArgs<Precision>& args, std::size_t begin, std::size_t end);
+
+    // Describes the in-place update exp(iθP) = cos θ·I + i sin θ·P by a Pauli string P, applied to the
+    // basis states whose control bits are all set. Since P|x⟩ = i^{#Y} (-1)^{|x & phaseMask|} |x ^ flipMask⟩,
+    // where flipMask holds the X and Y qubits and phaseMask the Z and Y qubits, each amplitude is only
+    // mixed with the one whose index differs by flipMask.
+    template <typename Precision>
+    struct PauliKernelArgs
+    {
+        std::complex<Precision>* amps;
+        std::size_t flipMask;
+        std::size_t phaseMask;
+        std::size_t controlMask;
+        std::size_t numY;
+        double theta;
+
+        // Masks of the control bits and, if flipMask is not zero, its lowest bit, sorted in ascending order.
+        // The updated pairs (or single amplitudes, if flipMask is zero) are numbered by counting over the
+        // bits of the state index not in `fixedBits`.
+        const std::size_t* fixedBits;
+        std::size_t numFixedBits;
+    };
+
+    // Applies the update to the pairs (or amplitudes) numbered [begin, end).
+    template <typename Precision>
+    void ApplyPauliKernel(const PauliKernelArgs<Precision>& args, std::size_t begin, std::size_t end);
+
+    // Name of the selected implementation for general gates in double precision.
+    const char* GateKernelName();
+
+} // namespace Quantum
+} // namespace Microsoft
@@ -0,0 +1,145 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+// Checks the in-place gate kernels of the state simulator against the dense approach the simulator started out with,
+// where each (controlled) gate is expanded into the full 2^n x 2^n unitary with Kronecker products and multiplied
+// with the state vector. Random circuits on 1 to maxQubits qubits are run on both, and the largest difference between
+// the resulting amplitudes is printed. Fails if it exceeds the tolerance.
+//
+// Usage: KernelCheck [maxQubits = 8] [numCircuits = 20] [numGates = 200]
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "StateSimulator.hpp"
+
+#include "Eigen/KroneckerProduct"
+#include "Eigen/MatrixFunctions"
+
+using namespace Microsoft::Quantum;
+using namespace Eigen;
+using namespace std::complex_literals;
+
+#define TOLERANCE 1e-10
+
+static Pauli PauliMatrix(PauliId axis)
+{
+    switch (axis) {
+        case PauliId_X:
+            return (Pauli() << 0,1,1,0).finished();
+        case PauliId_Y:
+            return (Pauli() << 0,-1i,1i,0).finished();
+        case PauliId_Z:
+            return (Pauli() << 1,0,0,-1).finished();
+        default:
+            return Pauli::Identity();
+    }
+}
+
+// Builds the unitary of a gate on `target` controlled on `controls` (given as qubit numbers, where qubit b is bit b
+// of the state index): U = 1 + |1..1⟩〈1..1|_controls ⊗ (G - 1)_target.
+static Operator ControlledUnitary(const Gate& gate, const std::vector<int>& controls, int target, int numQubits)
+{
+    Operator project1 = (Operator(2,2) << 0,0,0,1).finished();
+    Operator factor = Operator::Ones(1,1);
+    for (int b = numQubits - 1; b >= 0; b--) {
+        Operator single = Operator::Identity(2,2);
+        if (b == target)
+            single = gate - Gate::Identity();
+        else
+            for (int c : controls)
+                if (c == b)
+                    single = project1;
+        factor = kroneckerProduct(factor, single).eval();
+    }
+    long dim = long(1) << numQubits;
+    return Operator::Identity(dim, dim) + factor;
+}
+
+static std::vector<std::complex<double>> amplitudes;
+
+static bool StoreAmplitude(std::size_t index, double re, double im)
+{
+    amplitudes[index] = {re, im};
+    return true;
+}
+
+// Runs a random circuit on both the simulator and the dense reference, and returns the largest difference.
+static double RunCircuit(int numQubits, int numGates, std::mt19937_64& rng)
+{
+    StateSimulator<double> sim(1);
+    std::vector<Qubit> qubits;
+    for (int i = 0; i < numQubits; i++)
+        qubits.push_back(sim.AllocateQubit());
+    VectorXcd reference = VectorXcd::Zero(long(1) << numQubits);
+    reference(0) = 1;
+
+    for (int k = 0; k < numGates; k++) {
+        int target = rng() % numQubits;
+        std::vector<int> controls;
+        for (int c = 0, numControls = rng() % std::min(3, numQubits); c < numControls; c++) {
+            int control = rng() % numQubits;
+            if (control != target && std::find(controls.begin(), controls.end(), control) == controls.end())
+                controls.push_back(control);
+        }
+        std::vector<Qubit> controlQubits;
+        for (int c : controls)
+            controlQubits.push_back(qubits[c]);
+        long numControls = controls.size();
+        Qubit* ctls = controlQubits.data();
+        Qubit q = qubits[target];
+
+        double theta = std::uniform_real_distribution<double>(-M_PI, M_PI)(rng);
+        PauliId axis = PauliId(1 + rng() % 3);
+        Gate gate;
+        switch (rng() % 9) {
+            case 0: sim.ControlledX(numControls, ctls, q); gate = PauliMatrix(PauliId_X); break;
+            case 1: sim.ControlledY(numControls, ctls, q); gate = PauliMatrix(PauliId_Y); break;
+            case 2: sim.ControlledZ(numControls, ctls, q); gate = PauliMatrix(PauliId_Z); break;
+            case 3: sim.ControlledH(numControls, ctls, q); gate << 1, 1, 1, -1; gate /= std::sqrt(2.0); break;
+            case 4: sim.ControlledS(numControls, ctls, q); gate << 1, 0, 0, 1i; break;
+            case 5: sim.ControlledAdjointS(numControls, ctls, q); gate << 1, 0, 0, -1i; break;
+            case 6: sim.ControlledT(numControls, ctls, q); gate << 1, 0, 0, std::exp(1i * M_PI / 4.0); break;
+            case 7: sim.ControlledAdjointT(numControls, ctls, q); gate << 1, 0, 0, std::exp(-1i * M_PI / 4.0); break;
+            case 8:
+                sim.ControlledR(numControls, ctls, axis, q, theta);
+                gate = (-1i * theta / 2.0 * PauliMatrix(axis)).exp();
+                break;
+        }
+        reference = ControlledUnitary(gate, controls, target, numQubits) * reference;
+    }
+
+    // Without releases or cache blocking (the register fits into a block), qubit b stays in bit b.
+    amplitudes.assign(reference.size(), 0);
+    sim.GetState(StoreAmplitude);
+    double worst = 0;
+    for (long i = 0; i < reference.size(); i++)
+        worst = std::max(worst, std::abs(amplitudes[i] - reference(i)));
+    return worst;
+}
+
+int main(int argc, char* argv[])
+{
+    int maxQubits = argc > 1 ? std::atoi(argv[1]) : 8;
+    int numCircuits = argc > 2 ? std::atoi(argv[2]) : 20;
+    int numGates = argc > 3 ? std::atoi(argv[3]) : 200;
+
+    std::mt19937_64 rng(42);
+    double worst = 0;
+    for (int numQubits = 1; numQubits <= maxQubits; numQubits++) {
+        double worstForSize = 0;
+        for (int circuit = 0; circuit < numCircuits; circuit++)
+            worstForSize = std::max(worstForSize, RunCircuit(numQubits, numGates, rng));
+        std::printf("%2d qubits: largest difference %.3e\n", numQubits, worstForSize);
+        worst = std::max(worst, worstForSize);
+    }
+
+    bool passed = worst <= TOLERANCE;
+    std::printf("%s: largest difference %.3e (tolerance %.0e)\n", passed ? "PASSED" : "FAILED", worst, TOLERANCE);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+// Checks how far the single-precision state simulator drifts from the double-precision one over a long random circuit.
+// Both simulators run the same gates, and the infidelity 1 - |⟨Ψ_float|Ψ_double⟩|^2 and the norm of the single
+// precision state are printed at regular intervals. Fails if the infidelity ever exceeds the given bound.
+//
+// Usage: PrecisionCheck [numQubits = 16] [numGates = 20000] [maxInfidelity = 1e-6]
+
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "StateSimulator.hpp"
+
+using namespace Microsoft::Quantum;
+
+static std::vector<std::complex<double>> amplitudes;
+
+static bool StoreAmplitude(std::size_t index, double re, double im)
+{
+    amplitudes[index] = {re, im};
+    return true;
+}
+
+template <typename Precision>
+static std::vector<std::complex<double>> GetAmplitudes(StateSimulator<Precision>& sim, int numQubits)
+{
+    amplitudes.assign(std::size_t(1) << numQubits, 0);
+    sim.GetState(StoreAmplitude);
+    return amplitudes;
+}
+
+template <typename Precision>
+static void ApplyRandomGate(StateSimulator<Precision>& sim, std::vector<Qubit>& qubits, std::mt19937_64& rng)
+{
+    int n = qubits.size();
+    Qubit target = qubits[rng() % n], control = qubits[rng() % n];
+    double theta = std::uniform_real_distribution<double>(0, 2 * M_PI)(rng);
+    switch (rng() % 6) {
+        case 0: sim.H(target); break;
+        case 1: sim.T(target); break;
+        case 2: sim.R(PauliId_Y, target, theta); break;
+        case 3: sim.R(PauliId_X, target, theta); break;
+        case 4:
+            if (control != target)
+                sim.ControlledX(1, &control, target);
+            break;
+        case 5: {
+            PauliId paulis[2] = {PauliId_X, PauliId_Z};
+            Qubit targets[2] = {target, control};
+            if (control != target)
+                sim.Exp(2, paulis, targets, theta);
+            break;
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int numQubits = argc > 1 ? std::atoi(argv[1]) : 16;
+    long numGates = argc > 2 ? std::atol(argv[2]) : 20000;
+    double maxInfidelity = argc > 3 ? std::atof(argv[3]) : 1e-6;
+
+    // Blocks of the same number of amplitudes, so that both simulators move qubits to the same bits.
+    StateSimulatorSettings doubleSettings, floatSettings;
+    floatSettings.cacheBlockBytes = doubleSettings.cacheBlockBytes / 2;
+    StateSimulator<double> doubleSim(1, doubleSettings);
+    StateSimulator<float> floatSim(1, floatSettings);
+    std::vector<Qubit> doubleQubits, floatQubits;
+    for (int i = 0; i < numQubits; i++) {
+        doubleQubits.push_back(doubleSim.AllocateQubit());
+        floatQubits.push_back(floatSim.AllocateQubit());
+    }
+
+    std::mt19937_64 doubleRng(42), floatRng(42);
+    double worstInfidelity = 0;
+    long interval = std::max(1L, numGates / 10);
+    for (long done = 0; done < numGates; done += interval) {
+        for (long k = done; k < std::min(done + interval, numGates); k++) {
+            ApplyRandomGate(doubleSim, doubleQubits, doubleRng);
+            ApplyRandomGate(floatSim, floatQubits, floatRng);
+        }
+
+        std::vector<std::complex<double>> doubleState = GetAmplitudes(doubleSim, numQubits);
+        std::vector<std::complex<double>> floatState = GetAmplitudes(floatSim, numQubits);
+        std::complex<double> overlap = 0;
+        double floatNorm = 0;
+        for (std::size_t i = 0; i < doubleState.size(); i++) {
+            overlap += std::conj(floatState[i]) * doubleState[i];
+            floatNorm += std::norm(floatState[i]);
+        }
+        double infidelity = 1 - std::norm(overlap) / floatNorm;
+        worstInfidelity = std::max(worstInfidelity, infidelity);
+        std::printf("%7ld gates: infidelity %.3e, norm of single precision state - 1 = %+.3e\n",
+                    std::min(done + interval, numGates), infidelity, floatNorm - 1);
+    }
+
+    bool passed = worstInfidelity <= maxInfidelity;
+    std::printf("%s: worst infidelity %.3e (bound %.1e)\n", passed ? "PASSED" : "FAILED", worstInfidelity, maxInfidelity);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <cstdint>
+#include <limits>
+
+namespace Microsoft
+{
+namespace Quantum
+{
+    // The xoshiro256++ pseudo-random number generator by Blackman and Vigna (https://prng.di.unimi.it/).
+    // Each simulator owns its own generator, so that simulators don't share any state and can run on separate
+    // threads. Generators created from the same seed but different stream numbers produce non-overlapping
+    // sequences of 2^128 numbers each, so that many simulations can be run reproducibly from one seed.
+    // Satisfies the UniformRandomBitGenerator requirements, so it can also be used with <random> distributions.
+    class Xoshiro256PlusPlus
+    {
+        uint64_t state[4];
+
+        static uint64_t RotateLeft(uint64_t x, int k)
+        {
+            return (x << k) | (x >> (64 - k));
+        }
+
+        // Expands the seed into the full state, as recommended by the authors.
+        static uint64_t SplitMix64(uint64_t& x)
+        {
+            uint64_t z = (x += 0x9e3779b97f4a7c15);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+            return z ^ (z >> 31);
+        }
+
+      public:
+        using result_type = uint64_t;
+
+        explicit Xoshiro256PlusPlus(uint64_t seed = 0, uint64_t stream = 0)
+        {
+            for (uint64_t& word : this->state)
+                word = SplitMix64(seed);
+            for (uint64_t i = 0; i < stream; i++)
+                Jump();
+        }
+
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+        result_type operator()()
+        {
+            uint64_t result = RotateLeft(this->state[0] + this->state[3], 23) + this->state[0];
+            uint64_t t = this->state[1] << 17;
+            this->state[2] ^= this->state[0];
+            this->state[3] ^= this->state[1];
+            this->state[1] ^= this->state[2];
+            this->state[0] ^= this->state[3];
+            this->state[2] ^= t;
+            this->state[3] = RotateLeft(this->state[3], 45);
+            return result;
+        }
+
+        // Uniformly distributed in [0, 1), using the upper 53 bits.
+        double NextDouble()
+        {
+            return ((*this)() >> 11) * 0x1.0p-53;
+        }
+
+        // Advances the generator by 2^128 steps.
+        void Jump()
+        {
+            static const uint64_t jump[] = {0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c};
+            uint64_t jumped[4] = {0, 0, 0, 0};
+            for (uint64_t word : jump) {
+                for (int bit = 0; bit < 64; bit++) {
+                    if (word & (uint64_t(1) << bit))
+                        for (int i = 0; i < 4; i++)
+                            jumped[i] ^= this->state[i];
+                    (*this)();
+                }
+            }
+            for (int i = 0; i < 4; i++)
+                this->state[i] = jumped[i];
+        }
+    };
+
+} // namespace Quantum
+} // namespace Microsoft
@@ -10,23 +10,64 @@ using namespace Microsoft::Quantum;
 /// Qubit management
 ///
 
-Qubit StateSimulator::AllocateQubit()
+template <typename Precision>
+Qubit StateSimulator<Precision>::AllocateQubit()
 {
+    FlushGates();
     Qubit q = this->qbm->Allocate();
+    std::size_t id = this->qbm->GetQubitId(q);
+    if (id >= this->qubitPositions.size())
+        this->qubitPositions.resize(id + 1);
+    this->qubitPositions[id] = this->numActiveQubits;
     this->computeRegister.push_back(q);
-    UpdateState(this->numActiveQubits++);  // |Ψ'⟩ = |Ψ⟩ ⊗ |0⟩
+    if (this->classical) {
+        // The new bit is zero, i.e. |Ψ'⟩ = |0⟩ ⊗ |Ψ⟩ as well.
+        if (std::size_t(this->numActiveQubits) == 64 * this->classicalBits.size())
+            this->classicalBits.push_back(0);
+        this->numActiveQubits++;
+        return q;
+    }
+    UpdateState(this->numActiveQubits++);  // |Ψ'⟩ = |0⟩ ⊗ |Ψ⟩
     return q;
 }
 
-void StateSimulator::ReleaseQubit(Qubit q)
+template <typename Precision>
+void StateSimulator<Precision>::ReleaseQubit(Qubit q)
 {
-    UpdateState(GetQubitIdx(q), /*remove=*/true);  // ρ' = tr_i[|Ψ⟩〈Ψ|]
+    // Measured qubits can't be removed from the state vector before their measurements have been sampled.
+    // Their IDs aren't released either, so that they aren't reused while the qubits are still in the register.
+    if (this->measuredMask != 0 && (this->measuredMask & GetQubitMask(q)))
+        return;
+
+    FlushGates();
+    short position = GetQubitIdx(q);
+    if (this->classical) {
+        // Copy the most significant bit into the released qubit's bit, and clear it for reuse.
+        short top = this->numActiveQubits - 1;
+        if (GetClassicalBit(position) != GetClassicalBit(top))
+            FlipClassicalBit(position);
+        if (GetClassicalBit(top))
+            FlipClassicalBit(top);
+    }
+    else
+        UpdateState(position, /*remove=*/true);  // |Ψ⟩ = |Ψ'⟩ ⊗ |φ⟩ → |Ψ'⟩
+
+    // The most significant qubit moves into the released qubit's position.
+    Qubit top = this->computeRegister.back();
+    if (this->measuredMask != 0) {
+        std::size_t topMask = std::size_t(1) << (this->numActiveQubits - 1);
+        if (this->measuredMask & topMask)
+            this->measuredMask = (this->measuredMask & ~topMask) | (std::size_t(1) << position);
+    }
+    this->computeRegister[position] = top;
+    this->qubitPositions[this->qbm->GetQubitId(top)] = position;
+    this->computeRegister.pop_back();
     this->numActiveQubits--;
-    this->computeRegister.erase(this->computeRegister.begin() + GetQubitIdx(q));
     this->qbm->Release(q);
 }
 
-std::string StateSimulator::QubitToString(Qubit q)
+template <typename Precision>
+std::string StateSimulator<Precision>::QubitToString(Qubit q)
 {
     return std::to_string(this->qbm->GetQubitId(q));
 }
@@ -39,24 +80,58 @@ std::string StateSimulator::QubitToString(Qubit q)
 static Result zero = reinterpret_cast<Result>(0);
 static Result one = reinterpret_cast<Result>(1);
 
-void StateSimulator::ReleaseResult(Result r) {}
+template <typename Precision>
+void StateSimulator<Precision>::ReleaseResult(Result r) {}
 
-bool StateSimulator::AreEqualResults(Result r1, Result r2)
+template <typename Precision>
+bool StateSimulator<Precision>::AreEqualResults(Result r1, Result r2)
 {
+    if (this->deferMeasurements)
+        throw std::logic_error("operation_not_supported");
     return (r1 == r2);
 }
 
-ResultValue StateSimulator::GetResultValue(Result r)
+template <typename Precision>
+ResultValue StateSimulator<Precision>::GetResultValue(Result r)
 {
+    if (this->deferMeasurements)
+        throw std::logic_error("operation_not_supported");
     return (r == one) ? Result_One : Result_Zero;
 }
 
-Result StateSimulator::UseZero()
+template <typename Precision>
+Result StateSimulator<Precision>::UseZero()
 {
     return zero;
 }
 
-Result StateSimulator::UseOne()
+template <typename Precision>
+Result StateSimulator<Precision>::UseOne()
 {
     return one;
 }
+
+
+
+///
+/// Runtime driver instantiation
+///
+
+namespace Microsoft
+{
+namespace Quantum
+{
+    template class StateSimulator<float>;
+    template class StateSimulator<double>;
+
+    template <typename Precision>
+    std::unique_ptr<IRuntimeDriver> CreateStateSimulator(uint32_t userProvidedSeed, StateSimulatorSettings settings)
+    {
+        return std::make_unique<StateSimulator<Precision>>(userProvidedSeed, settings);
+    }
+
+    template std::unique_ptr<IRuntimeDriver> CreateStateSimulator<float>(uint32_t, StateSimulatorSettings);
+    template std::unique_ptr<IRuntimeDriver> CreateStateSimulator<double>(uint32_t, StateSimulatorSettings);
+
+} // namespace Quantum
+} // namespace Microsoft
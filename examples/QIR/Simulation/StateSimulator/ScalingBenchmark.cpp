@@ -0,0 +1,71 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+// Measures how the time to apply a gate to the state vector scales with the number of threads, for a range of
+// register sizes. Gate fusion and cache blocking are turned off, so that every gate takes its own pass over the
+// state vector. For each size, the time per gate and the speed-up over a single thread are printed for 1, 2, 4, ...
+// threads up to the given maximum. Note that 30 qubits take 16 GiB of memory.
+//
+// Usage: ScalingBenchmark [minQubits = 16] [maxQubits = 30] [maxThreads = 0 (all hardware threads)]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "StateSimulator.hpp"
+
+using namespace Microsoft::Quantum;
+
+// Returns the average time in seconds to apply a gate, over a layer of H, T and CNOT gates on all qubits.
+static double TimePerGate(int numQubits, unsigned numThreads)
+{
+    StateSimulatorSettings settings;
+    settings.numThreads = numThreads;
+    settings.fusionWidth = 0;
+    settings.cacheBlockBytes = 0;
+    StateSimulator<double> sim(1, settings);
+    std::vector<Qubit> qubits;
+    for (int i = 0; i < numQubits; i++)
+        qubits.push_back(sim.AllocateQubit());
+
+    // Repeat small registers, so that the timer resolution doesn't matter.
+    int repetitions = std::max(1, 1 << (24 - std::min(numQubits, 24)));
+    std::size_t numGates = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repetitions; r++) {
+        for (int i = 0; i < numQubits; i++) {
+            sim.H(qubits[i]);
+            sim.T(qubits[i]);
+            sim.ControlledX(1, &qubits[i], qubits[(i + 1) % numQubits]);
+            numGates += 3;
+        }
+    }
+    // Reading the state applies any gates still queued.
+    sim.GetState([](std::size_t, double, double) { return false; });
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / numGates;
+}
+
+int main(int argc, char* argv[])
+{
+    int minQubits = argc > 1 ? std::atoi(argv[1]) : 16;
+    int maxQubits = argc > 2 ? std::atoi(argv[2]) : 30;
+    unsigned maxThreads = argc > 3 ? std::atoi(argv[3]) : 0;
+    if (maxThreads == 0)
+        maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int numQubits = minQubits; numQubits <= maxQubits; numQubits++) {
+        double serialTime = 0;
+        for (unsigned numThreads = 1;; numThreads = std::min(2 * numThreads, maxThreads)) {
+            double time = TimePerGate(numQubits, numThreads);
+            if (numThreads == 1)
+                serialTime = time;
+            std::printf("%2d qubits, %3u threads: %10.3f us/gate, speed-up %5.2f\n", numQubits, numThreads, time * 1e6,
+                        serialTime / time);
+            if (numThreads == maxThreads)
+                break;
+        }
+    }
+    return 0;
+}
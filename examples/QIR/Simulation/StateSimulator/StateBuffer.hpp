@@ -0,0 +1,180 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <algorithm>
+#include <complex>
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace Microsoft
+{
+namespace Quantum
+{
+    // Storage for the state vector, which only ever grows or shrinks by a factor of two at a time.
+    // Capacity is kept when shrinking and doubled when growing past it, so that allocating and releasing
+    // qubits one by one neither reallocates nor copies the amplitudes more than once per doubling.
+    // The memory is aligned to (at least) 64 bytes, i.e. a cache line or an AVX-512 register.
+    // On Linux, the amplitudes can instead be kept in a file mapped into memory, for state vectors beyond RAM.
+    template <typename Precision>
+    class StateBuffer
+    {
+        using Amplitude = std::complex<Precision>;
+
+        static constexpr std::size_t alignment = 64;
+
+        // Buffers at least this large may be backed by transparent huge pages.
+        static constexpr std::size_t hugePageSize = std::size_t(1) << 21;
+
+        Amplitude* amps = nullptr;
+        std::size_t length = 0;
+        std::size_t capacity = 0;
+        bool hugePages;
+
+        // Descriptor of the backing file, or -1 for anonymous memory.
+        int file = -1;
+
+        Amplitude* Allocate(std::size_t capacity, bool hugePages)
+        {
+            std::size_t bytes = capacity * sizeof(Amplitude);
+#if defined(__linux__)
+            if (this->file >= 0) {
+                // The kernel reads pages in ahead of sequential sweeps and writes them back as it needs the memory.
+                if (ftruncate(this->file, bytes) != 0)
+                    throw std::bad_alloc();
+                void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, this->file, 0);
+                if (memory == MAP_FAILED)
+                    throw std::bad_alloc();
+                madvise(memory, bytes, MADV_SEQUENTIAL);
+                return static_cast<Amplitude*>(memory);
+            }
+            // Anonymous mappings are page-aligned and only backed by memory once touched,
+            // so reserving a large capacity up front is cheap.
+            void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory == MAP_FAILED)
+                throw std::bad_alloc();
+            if (hugePages && bytes >= hugePageSize)
+                madvise(memory, bytes, MADV_HUGEPAGE);
+            return static_cast<Amplitude*>(memory);
+#else
+            return static_cast<Amplitude*>(::operator new(bytes, std::align_val_t(alignment)));
+#endif
+        }
+
+        static void Free(Amplitude* amps, std::size_t capacity)
+        {
+            if (amps == nullptr)
+                return;
+#if defined(__linux__)
+            munmap(amps, capacity * sizeof(Amplitude));
+#else
+            ::operator delete(amps, std::align_val_t(alignment));
+#endif
+        }
+
+        void Reallocate(std::size_t newCapacity)
+        {
+#if defined(__linux__)
+            if (this->amps != nullptr) {
+                // Moves the pages to a larger mapping if needed, without copying their contents.
+                std::size_t bytes = newCapacity * sizeof(Amplitude);
+                if (this->file >= 0 && ftruncate(this->file, bytes) != 0)
+                    throw std::bad_alloc();
+                void* memory = mremap(this->amps, this->capacity * sizeof(Amplitude), bytes, MREMAP_MAYMOVE);
+                if (memory == MAP_FAILED)
+                    throw std::bad_alloc();
+                if (this->file >= 0)
+                    madvise(memory, bytes, MADV_SEQUENTIAL);
+                else if (this->hugePages && bytes >= hugePageSize)
+                    madvise(memory, bytes, MADV_HUGEPAGE);
+                this->amps = static_cast<Amplitude*>(memory);
+                this->capacity = newCapacity;
+                return;
+            }
+#endif
+            Amplitude* newAmps = Allocate(newCapacity, this->hugePages);
+            std::copy(this->amps, this->amps + this->length, newAmps);
+            Free(this->amps, this->capacity);
+            this->amps = newAmps;
+            this->capacity = newCapacity;
+        }
+
+      public:
+        // Starts out as the scalar 1, with room for the given number of qubits. If a backing file is given, it is
+        // created, and removed again right away so that nothing is left behind on exit. The file must not exist yet,
+        // so that a mistyped path can't destroy an existing file.
+        explicit StateBuffer(unsigned reservedQubits = 0, bool hugePages = false, const std::string& backingFile = "")
+            : hugePages(hugePages)
+        {
+            if (!backingFile.empty()) {
+#if defined(__linux__)
+                this->file = open(backingFile.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+                if (this->file < 0)
+                    throw std::runtime_error("cannot create state file " + backingFile + " (it must not exist yet)");
+                unlink(backingFile.c_str());
+#else
+                throw std::logic_error("operation_not_supported");
+#endif
+            }
+            Reallocate(std::size_t(1) << reservedQubits);
+            this->amps[0] = 1;
+            this->length = 1;
+        }
+        ~StateBuffer()
+        {
+            Free(this->amps, this->capacity);
+#if defined(__linux__)
+            if (this->file >= 0)
+                close(this->file);
+#endif
+        }
+        StateBuffer(const StateBuffer&) = delete;
+        StateBuffer& operator=(const StateBuffer&) = delete;
+
+        Amplitude* data() { return this->amps; }
+        const Amplitude* data() const { return this->amps; }
+        std::size_t size() const { return this->length; }
+
+        Amplitude& operator[](std::size_t i) { return this->amps[i]; }
+        const Amplitude& operator[](std::size_t i) const { return this->amps[i]; }
+
+        bool IsFileBacked() const { return this->file >= 0; }
+
+        // Hints that the given range of amplitudes is about to be accessed, so that a backing file is read in ahead.
+        void Prefetch(std::size_t begin, std::size_t count) const
+        {
+#if defined(__linux__)
+            if (this->file < 0 || begin >= this->length)
+                return;
+            count = std::min(count, this->length - begin);
+            std::size_t pageSize = sysconf(_SC_PAGESIZE);
+            std::size_t start = begin * sizeof(Amplitude) / pageSize * pageSize;
+            madvise(reinterpret_cast<char*>(this->amps) + start, (begin + count) * sizeof(Amplitude) - start, MADV_WILLNEED);
+#endif
+        }
+
+        // Doubles the size, setting the new upper half to zero.
+        void Grow()
+        {
+            if (2*this->length > this->capacity)
+                Reallocate(2*this->length);
+            std::fill(this->amps + this->length, this->amps + 2*this->length, Amplitude(0));
+            this->length *= 2;
+        }
+
+        // Halves the size, dropping the upper half but keeping its memory for later growth.
+        void Shrink()
+        {
+            this->length /= 2;
+        }
+    };
+
+} // namespace Quantum
+} // namespace Microsoft
@@ -1,12 +1,14 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT License.
 
+#include <bitset>
 #include <complex>
+#include <cstddef>
+#include <cstdlib>
 #include <utility>
 
 #include "StateSimulator.hpp"
 
-#include "Eigen/KroneckerProduct"
 #include "Eigen/MatrixFunctions"
 
 using namespace Microsoft::Quantum;
@@ -16,27 +18,9 @@ using namespace std::complex_literals;
 # define PI 3.14159265358979323846
 # define TOLERANCE 1e-6
 
-static Operator PartialTrace(Operator u, short idx, short dim)
+static bool Parity(std::size_t bits)
 {
-    // Partial trace defined as:
-    //    tr_B[U] = (Id ⊗ 〈0|) U (Id ⊗ |0⟩) + (Id ⊗ 〈1|) U (Id ⊗ |1⟩)
-    // This is expanded to arbitrary sized systems where a single qubit is traced out.
-    Operator proj_zero = Operator::Ones(1,1), proj_one = Operator::Ones(1,1);
-    for (int i = 0; i < idx; i++) {
-        proj_zero = kroneckerProduct(proj_zero, Operator::Identity(2,2)).eval();
-        proj_one = kroneckerProduct(proj_one, Operator::Identity(2,2)).eval();
-    }
-    proj_zero = kroneckerProduct(proj_zero, Vector2cd(1,0)).eval();
-    proj_one = kroneckerProduct(proj_one, Vector2cd(0,1)).eval();
-    for (int i = idx+1; i < dim; i++) {
-        proj_zero = kroneckerProduct(proj_zero, Operator::Identity(2,2)).eval();
-        proj_one = kroneckerProduct(proj_one, Operator::Identity(2,2)).eval();
-    }
-
-    Operator result = proj_zero.adjoint() * u * proj_zero
-                    + proj_one.adjoint() * u * proj_one;
-
-    return result;
+    return std::bitset<64>(bits).count() % 2 == 1;
 }
 
 static Pauli SelectPauliOp(PauliId axis)
@@ -58,95 +42,169 @@ static Pauli SelectPauliOp(PauliId axis)
 /// State manipulation
 ///
 
-void StateSimulator::UpdateState(short qubitIndex, bool remove)
+template <typename Precision>
+void StateSimulator<Precision>::UpdateState(short qubitIndex, bool remove)
 {
-    // When adding a qubit, the state vector can be updated with: |Ψ'⟩ = |Ψ⟩ ⊗ |0⟩.
-    // When removing a qubit, it is traced out from the state vector: ρ' = tr_i[|Ψ⟩〈Ψ|].
+    // When adding a qubit as the most significant bit, the state vector is updated with: |Ψ'⟩ = |0⟩ ⊗ |Ψ⟩,
+    // i.e. it is extended with zeros.
+    // When removing a qubit, it must be in a product state |Ψ⟩ = |Ψ'⟩ ⊗ (c_0|0⟩ + c_1|1⟩), so each half of
+    // the state vector for a fixed value of the qubit's bit is proportional to |Ψ'⟩.
     if (!remove) {
-        this->stateVec = kroneckerProduct(this->stateVec, Vector2cd(1,0)).eval();
-    } else {
-        Operator densityMatrix = this->stateVec * this->stateVec.adjoint();
-        densityMatrix = PartialTrace(densityMatrix, qubitIndex, this->numActiveQubits);
-
-        // Ensure state is pure tr(ρ^2)=1, meaning the removed qubit was in a product state.
-        assert(abs((densityMatrix*densityMatrix).trace()-1.0) < TOLERANCE);
-
-        SelfAdjointEigenSolver<Operator> eigensolver(densityMatrix);
-        assert(eigensolver.info() == Success && "Failed to decompose density matrix.");
+        this->stateVec.Grow();
+        return;
+    }
 
-        Index maxEigenIdx;
-        ArrayXd eigenvals = eigensolver.eigenvalues().array();
-        eigenvals.abs().maxCoeff(&maxEigenIdx);
-        assert(abs(eigenvals(maxEigenIdx) - 1.0) < TOLERANCE);
+    std::size_t stride = std::size_t(1) << qubitIndex;
+    std::size_t halfDim = this->stateVec.size() / 2;
+    Amplitude* amps = this->stateVec.data();
+
+    // Compute the norms of both halves and their overlap in one pass.
+    struct HalfSums
+    {
+        double norm0 = 0, norm1 = 0;
+        std::complex<double> overlap = 0;
+
+        HalfSums& operator+=(const HalfSums& other)
+        {
+            norm0 += other.norm0;
+            norm1 += other.norm1;
+            overlap += other.overlap;
+            return *this;
+        }
+    };
+    HalfSums sums = this->pool->ParallelSum<HalfSums>(halfDim, [&](std::size_t begin, std::size_t end) {
+        HalfSums partial;
+        for (std::size_t k = begin; k < end; k++) {
+            std::size_t i = ((k & ~(stride - 1)) << 1) | (k & (stride - 1));
+            partial.norm0 += std::norm(amps[i]);
+            partial.norm1 += std::norm(amps[i + stride]);
+            partial.overlap += std::conj(amps[i]) * amps[i + stride];
+        }
+        return partial;
+    });
 
-        this->stateVec = eigensolver.eigenvectors().col(maxEigenIdx);
+    // Ensure the qubit is in a product state, i.e. both halves are parallel: |〈Ψ_0|Ψ_1⟩|^2 = 〈Ψ_0|Ψ_0⟩〈Ψ_1|Ψ_1⟩.
+    assert(abs(std::norm(sums.overlap) - sums.norm0*sums.norm1) < TOLERANCE);
+
+    // Keep the larger half, which is |Ψ'⟩ up to normalization, while the most significant qubit moves into the
+    // removed qubit's bit, so that the top half of the vector can be dropped. Only the norm is divided out, so that
+    // e.g. a qubit left in |0⟩ or |1⟩ doesn't alter the phase of |Ψ'⟩.
+    bool keepOne = sums.norm1 > sums.norm0;
+    Precision factor = Precision(1/sqrt(keepOne ? sums.norm1 : sums.norm0));
+    std::size_t keptBit = keepOne ? stride : 0;
+    if (stride == halfDim) {
+        // The removed qubit is the most significant one, so the kept half only needs to be moved to the bottom.
+        this->pool->ParallelFor(halfDim, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t k = begin; k < end; k++)
+                amps[k] = amps[k | keptBit] * factor;
+        });
+    } else {
+        // Each pair (i, i + stride) of the lower half takes the kept amplitude of the pair, and the one with the most
+        // significant qubit set from the top half. Every iteration only reads its own pair and the top half, which
+        // no iteration writes to, so that the pairs can be updated in parallel.
+        this->pool->ParallelFor(halfDim / 2, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t k = begin; k < end; k++) {
+                std::size_t i = ((k & ~(stride - 1)) << 1) | (k & (stride - 1));
+                amps[i] = amps[i | keptBit] * factor;
+                amps[i | stride] = amps[i | keptBit | halfDim] * factor;
+            }
+        });
     }
+    this->stateVec.Shrink();
 }
 
-void StateSimulator::ApplyGate(Gate gate, Qubit target)
+template <typename Precision>
+void StateSimulator<Precision>::Densify()
 {
-    // Construct unitary as Id_A ⊗ G ⊗ Id_C, split by the qubit index.
-    short qubitIndex = GetQubitIdx(target);
-    long dimA = pow(2, qubitIndex);
-    long dimC = pow(2, this->numActiveQubits-qubitIndex-1);
-    Operator unitary = Operator::Identity(dimA, dimA);
-    unitary = kroneckerProduct(unitary, gate).eval();
-    unitary = kroneckerProduct(unitary, Operator::Identity(dimC, dimC)).eval();
+    if (!this->classical)
+        return;
+    if (this->numActiveQubits >= 64)
+        throw std::logic_error("qubit_limit_exceeded");
+
+    // The state vector is still the scalar 1, so growing it gives |0...0⟩, which is then moved to the basis state.
+    std::size_t index = 0;
+    for (short b = 0; b < this->numActiveQubits; b++) {
+        if (GetClassicalBit(b))
+            index |= std::size_t(1) << b;
+        this->stateVec.Grow();
+    }
+    this->stateVec[0] = 0;
+    this->stateVec[index] = Amplitude(this->classicalPhase);
+    this->classical = false;
+}
 
-    // Apply gate with |Ψ'⟩ = U|Ψ⟩.
-    this->stateVec = unitary*this->stateVec;
+template <typename Precision>
+void StateSimulator<Precision>::ApplyGate(Gate gate, Qubit target)
+{
+    // The unitary Id_A ⊗ G ⊗ Id_C only ever mixes pairs of amplitudes whose indices differ in the
+    // target qubit's bit, so it can be applied in place to each pair (i, i + stride) without
+    // constructing the full 2^n x 2^n operator. This is the special case of a controlled gate
+    // without any controls.
+    ApplyControlledGate(gate, 0, nullptr, target);
 }
 
-void StateSimulator::ApplyControlledGate(Gate gate, long numControls, Qubit controls[], Qubit target)
+template <typename Precision>
+void StateSimulator<Precision>::ApplyControlledGate(Gate gate, long numControls, Qubit controls[], Qubit target)
 {
-    // Controlled unitary on a bipartite system A⊗B can be expressed as:
-    //     cU = (|0⟩〈0| ⊗ 1) + (|1⟩〈1| ⊗ U)    if control on A
-    //     cU = (1 ⊗ |0⟩〈0|) + (U ⊗ |1⟩〈1|)    if control on B
-    // Thus, the full unitary will be built starting from target in both directions
-    // to handle controls coming both before and after the target.
-    short targetIndex = GetQubitIdx(target);
-    std::vector<short> preTargetIndices, postTargetIndices;
-    for (int i = 0; i < numControls; i++) {
-        short idx = GetQubitIdx(controls[i]);
-        if (idx < targetIndex)
-            preTargetIndices.push_back(idx);
-        else
-            postTargetIndices.push_back(idx);
+    if (this->classical) {
+        if (!AreClassicalControlsSet(numControls, controls))
+            return;
+        Densify();
     }
-    sort(preTargetIndices.begin(), preTargetIndices.end());
-    sort(postTargetIndices.begin(), postTargetIndices.end());
-
-    long dimU = 2;
-    Operator unitary = gate;
-    Operator project0 = (Operator(2,2) << 1,0,0,0).finished();
-    Operator project1 = (Operator(2,2) << 0,0,0,1).finished();
-    // Build up unitary from target to last qubit.
-    auto controlItFw = postTargetIndices.begin();
-    for (int i = targetIndex+1; i < this->numActiveQubits; i++) {
-        if (controlItFw != postTargetIndices.end() && i == *controlItFw) {
-            unitary = (kroneckerProduct(Operator::Identity(dimU, dimU), project0) // 1 ⊗ |0⟩〈0|
-                      +kroneckerProduct(unitary, project1)).eval();               // U ⊗ |1⟩〈1|
-            controlItFw++;
-        } else {
-            unitary = kroneckerProduct(unitary, Operator::Identity(2,2)).eval();
-        }
-        dimU *= 2;
+    QueueGate(MakeKernelArgs(GateKernelType_General, gate), numControls, controls, target);
+}
+
+template <typename Precision>
+void StateSimulator<Precision>::ApplyDiagonalGate(std::complex<double> phase0, std::complex<double> phase1,
+                                       long numControls, Qubit controls[], Qubit target)
+{
+    if (this->classical) {
+        if (AreClassicalControlsSet(numControls, controls))
+            this->classicalPhase *= GetClassicalBit(GetQubitIdx(target)) ? phase1 : phase0;
+        return;
     }
-    // Build up the unitary from target to first qubit.
-    auto controlItBw = preTargetIndices.rbegin();
-    for (int i = targetIndex-1; i >= 0; i--) {
-        if (controlItBw != preTargetIndices.rend() && i == *controlItBw) {
-            unitary = (kroneckerProduct(project0, Operator::Identity(dimU, dimU)) // |0⟩〈0| ⊗ 1
-                      +kroneckerProduct(project1, unitary)).eval();               // |1⟩〈1| ⊗ U
-            controlItBw++;
-        } else {
-            unitary = kroneckerProduct(Operator::Identity(2,2), unitary).eval();
+    QueueGate(MakeKernelArgs(GateKernelType_Diagonal, (Gate() << phase0, 0, 0, phase1).finished()),
+              numControls, controls, target);
+}
+
+template <typename Precision>
+void StateSimulator<Precision>::ApplyPermutationGate(std::complex<double> phase01, std::complex<double> phase10,
+                                          long numControls, Qubit controls[], Qubit target)
+{
+    if (this->classical) {
+        if (AreClassicalControlsSet(numControls, controls)) {
+            short position = GetQubitIdx(target);
+            this->classicalPhase *= GetClassicalBit(position) ? phase01 : phase10;
+            FlipClassicalBit(position);
         }
-        dimU *= 2;
+        return;
     }
+    QueueGate(MakeKernelArgs(GateKernelType_Permutation, (Gate() << 0, phase01, phase10, 0).finished()),
+              numControls, controls, target);
+}
 
-    // Apply gate with |Ψ'⟩ = U|Ψ⟩.
-    this->stateVec = unitary*this->stateVec;
+template <typename Precision>
+void StateSimulator<Precision>::RunGateKernel(GateKernelArgs<Precision> args)
+{
+    // Controlled unitary on a bipartite system A⊗B can be expressed as:
+    //     cU = (|0⟩〈0| ⊗ 1) + (|1⟩〈1| ⊗ U)
+    // Hence the gate only mixes amplitude pairs (i, i + stride) whose control bits are all set, and
+    // acts as the identity on everything else. These pairs are enumerated directly by counting over
+    // the remaining free bits and inserting the fixed target and control bits into each index.
+    std::vector<std::size_t> fixedBits;
+    std::size_t qubitMask = args.targetMask | args.controlMask;
+    for (std::size_t mask = 1; mask != 0 && mask <= qubitMask; mask <<= 1)
+        if (qubitMask & mask)
+            fixedBits.push_back(mask);
+
+    args.amps = this->stateVec.data();
+    args.fixedBits = fixedBits.data();
+    args.numFixedBits = fixedBits.size();
+
+    std::size_t numPairs = this->stateVec.size() >> fixedBits.size();
+    this->pool->ParallelFor(numPairs, [&](std::size_t begin, std::size_t end) {
+        ApplyGateKernel(args, begin, end);
+    });
 }
 
 
@@ -154,49 +212,44 @@ void StateSimulator::ApplyControlledGate(Gate gate, long numControls, Qubit cont
 /// Supported quantum operations
 ///
 
-void StateSimulator::X(Qubit q)
+template <typename Precision>
+void StateSimulator<Precision>::X(Qubit q)
 {
-    Gate x; x << 0, 1,
-                 1, 0;
-    ApplyGate(x, q);
+    ApplyPermutationGate(1, 1, 0, nullptr, q);
 }
 
-void StateSimulator::ControlledX(long numControls, Qubit controls[], Qubit target)
+template <typename Precision>
+void StateSimulator<Precision>::ControlledX(long numControls, Qubit controls[], Qubit target)
 {
-    Gate x; x << 0, 1,
-                 1, 0;
-    ApplyControlledGate(x, numControls, controls, target);
+    ApplyPermutationGate(1, 1, numControls, controls, target);
 }
 
-void StateSimulator::Y(Qubit q)
+template <typename Precision>
+void StateSimulator<Precision>::Y(Qubit q)
 {
-    Gate y; y <<  0,-1i,
-                 1i,  0;
-    ApplyGate(y, q);
+    ApplyPermutationGate(-1i, 1i, 0, nullptr, q);
 }
 
-void StateSimulator::ControlledY(long numControls, Qubit controls[], Qubit target)
+template <typename Precision>
+void StateSimulator<Precision>::ControlledY(long numControls, Qubit controls[], Qubit target)
 {
-    Gate y; y <<  0,-1i,
-                 1i,  0;
-    ApplyControlledGate(y, numControls, controls, target);
+    ApplyPermutationGate(-1i, 1i, numControls, controls, target);
 }
 
-void StateSimulator::Z(Qubit q)
+template <typename Precision>
+void StateSimulator<Precision>::Z(Qubit q)
 {
-    Gate z; z << 1, 0,
-                 0,-1;
-    ApplyGate(z, q);
+    ApplyDiagonalGate(1, -1, 0, nullptr, q);
 }
 
-void StateSimulator::ControlledZ(long numControls, Qubit controls[], Qubit target)
+template <typename Precision>
+void StateSimulator<Precision>::ControlledZ(long numControls, Qubit controls[], Qubit target)
 {
-    Gate z; z << 1, 0,
-                 0,-1;
-    ApplyControlledGate(z, numControls, controls, target);
+    ApplyDiagonalGate(1, -1, numControls, controls, target);
 }
 
-void StateSimulator::H(Qubit q)
+template <typename Precision>
+void StateSimulator<Precision>::H(Qubit q)
 {
     Gate h; h << 1, 1,
                  1,-1;
@@ -204,7 +257,8 @@ void StateSimulator::H(Qubit q)
     ApplyGate(h, q);
 }
 
-void StateSimulator::ControlledH(long numControls, Qubit controls[], Qubit target)
+template <typename Precision>
+void StateSimulator<Precision>::ControlledH(long numControls, Qubit controls[], Qubit target)
 {
     Gate h; h << 1, 1,
                  1,-1;
@@ -212,130 +266,351 @@ void StateSimulator::ControlledH(long numControls, Qubit controls[], Qubit targe
     ApplyControlledGate(h, numControls, controls, target);
 }
 
-void StateSimulator::S(Qubit q)
+template <typename Precision>
+void StateSimulator<Precision>::S(Qubit q)
 {
-    Gate s; s << 1,  0,
-                 0, 1i;
-    ApplyGate(s, q);
+    ApplyDiagonalGate(1, 1i, 0, nullptr, q);
 }
 
-void StateSimulator::ControlledS(long numControls, Qubit controls[], Qubit target)
+template <typename Precision>
+void StateSimulator<Precision>::ControlledS(long numControls, Qubit controls[], Qubit target)
 {
-    Gate s; s << 1,  0,
-                 0, 1i;
-    ApplyControlledGate(s, numControls, controls, target);
+    ApplyDiagonalGate(1, 1i, numControls, controls, target);
 }
 
-void StateSimulator::AdjointS(Qubit q)
+template <typename Precision>
+void StateSimulator<Precision>::AdjointS(Qubit q)
 {
-    Gate sdag; sdag << 1,  0,
-                       0,-1i;
-    ApplyGate(sdag, q);
+    ApplyDiagonalGate(1, -1i, 0, nullptr, q);
 }
 
-void StateSimulator::ControlledAdjointS(long numControls, Qubit controls[], Qubit target)
+template <typename Precision>
+void StateSimulator<Precision>::ControlledAdjointS(long numControls, Qubit controls[], Qubit target)
 {
-    Gate sdag; sdag << 1,  0,
-                       0,-1i;
-    ApplyControlledGate(sdag, numControls, controls, target);
+    ApplyDiagonalGate(1, -1i, numControls, controls, target);
 }
 
-void StateSimulator::T(Qubit q)
+template <typename Precision>
+void StateSimulator<Precision>::T(Qubit q)
 {
-    Gate t; t << 1, 0,
-                 0, exp(1i*PI/4.);
-    ApplyGate(t, q);
+    ApplyDiagonalGate(1, exp(1i*PI/4.), 0, nullptr, q);
 }
 
-void StateSimulator::ControlledT(long numControls, Qubit controls[], Qubit target)
+template <typename Precision>
+void StateSimulator<Precision>::ControlledT(long numControls, Qubit controls[], Qubit target)
 {
-    Gate t; t << 1, 0,
-                 0, exp(1i*PI/4.);
-    ApplyControlledGate(t, numControls, controls, target);
+    ApplyDiagonalGate(1, exp(1i*PI/4.), numControls, controls, target);
 }
 
-void StateSimulator::AdjointT(Qubit q)
+template <typename Precision>
+void StateSimulator<Precision>::AdjointT(Qubit q)
 {
-    Gate tdag; tdag << 1, 0,
-                       0, exp(-1i*PI/4.);
-    ApplyGate(tdag, q);
+    ApplyDiagonalGate(1, exp(-1i*PI/4.), 0, nullptr, q);
 }
 
-void StateSimulator::ControlledAdjointT(long numControls, Qubit controls[], Qubit target)
+template <typename Precision>
+void StateSimulator<Precision>::ControlledAdjointT(long numControls, Qubit controls[], Qubit target)
 {
-    Gate tdag; tdag << 1, 0,
-                       0, exp(-1i*PI/4.);
-    ApplyControlledGate(tdag, numControls, controls, target);
+    ApplyDiagonalGate(1, exp(-1i*PI/4.), numControls, controls, target);
 }
 
-void StateSimulator::R(PauliId axis, Qubit q, double theta)
+template <typename Precision>
+void StateSimulator<Precision>::R(PauliId axis, Qubit q, double theta)
 {
-    Gate r = (-1i*theta/2.0*SelectPauliOp(axis)).exp();
-    ApplyGate(r, q);
+    ControlledR(0, nullptr, axis, q, theta);
 }
 
-void StateSimulator::ControlledR(long numControls, Qubit controls[], PauliId axis, Qubit target, double theta)
+template <typename Precision>
+void StateSimulator<Precision>::ControlledR(long numControls, Qubit controls[], PauliId axis, Qubit target, double theta)
 {
+    // Rotations about Z (and the identity) are diagonal: R_Z(θ) = diag(e^{-iθ/2}, e^{iθ/2}).
+    if (axis == PauliId_Z || axis == PauliId_I) {
+        std::complex<double> phase = exp(-1i*theta/2.0);
+        ApplyDiagonalGate(phase, axis == PauliId_Z ? conj(phase) : phase, numControls, controls, target);
+        return;
+    }
+
     Gate r = (-1i*theta/2.0*SelectPauliOp(axis)).exp();
     ApplyControlledGate(r, numControls, controls, target);
 }
 
-void StateSimulator::Exp(long numTargets, PauliId paulis[], Qubit targets[], double theta)
+template <typename Precision>
+void StateSimulator<Precision>::Exp(long numTargets, PauliId paulis[], Qubit targets[], double theta)
 {
-    Operator u = (1i*theta*BuildPauliUnitary(numTargets, paulis, targets)).exp();
-    this->stateVec = u*this->stateVec;
+    ApplyPauliRotation(0, nullptr, numTargets, paulis, targets, theta);
 }
 
-void StateSimulator::ControlledExp(long numControls, Qubit controls[], long numTargets, PauliId paulis[], Qubit targets[], double theta)
+template <typename Precision>
+void StateSimulator<Precision>::ControlledExp(long numControls, Qubit controls[], long numTargets, PauliId paulis[], Qubit targets[], double theta)
 {
-    throw std::logic_error("operation_not_supported");
+    ApplyPauliRotation(numControls, controls, numTargets, paulis, targets, theta);
 }
 
-Result StateSimulator::Measure(long numBases, PauliId bases[], long numTargets, Qubit targets[])
+template <typename Precision>
+Result StateSimulator<Precision>::Measure(long numBases, PauliId bases[], long numTargets, Qubit targets[])
 {
     assert(numBases == numTargets);
-    short dim = this->numActiveQubits;
+
+    // In classical mode, measurements in the computational basis just read the parity of the basis state.
+    if (this->classical && !this->deferMeasurements &&
+        std::all_of(bases, bases + numBases, [](PauliId b) { return b == PauliId_I || b == PauliId_Z; })) {
+        bool oddParity = false;
+        for (long i = 0; i < numBases; i++)
+            if (bases[i] == PauliId_Z)
+                oddParity ^= GetClassicalBit(GetQubitIdx(targets[i]));
+        return oddParity ? UseOne() : UseZero();
+    }
+
+    Densify();
+    FlushGates();
+    if (this->deferMeasurements)
+        return DeferMeasurement(numBases, bases, targets);
 
     // Projection operators P_+- for Pauli measurements {P_i}:
     //     P_+- = (1 +- P_1⊗P_2⊗..⊗P_n)/2
-    Operator paulis = BuildPauliUnitary(numTargets, bases, targets);
-    Operator p_projector = (Operator::Identity(dim, dim) + paulis)/2;
-    Operator m_projector = (Operator::Identity(dim, dim) - paulis)/2;
-
-    // Probability of getting outcome Zero is p(+) = 〈Ψ|P_+|Ψ⟩.
-    double probZero = real(this->stateVec.conjugate().dot(p_projector*this->stateVec));
+    // After rotating each qubit into the eigenbasis of its Pauli operator, this becomes a parity
+    // measurement in the computational basis, where P_+ (P_-) keeps exactly those basis states with
+    // an even (odd) number of 1s among the measured qubits. No operator is ever built.
+    std::size_t parityMask = RotateBasis(numBases, bases, targets, /*toComputational=*/true);
+    Amplitude* amps = this->stateVec.data();
+
+    // Probability of getting outcome Zero is p(+) = 〈Ψ|P_+|Ψ⟩.
+    // Both outcomes are summed up, so that rounding errors in the norm of the state vector, which add up quicker
+    // in single precision, are divided out rather than skewing the probabilities.
+    struct ParitySums
+    {
+        double even = 0, odd = 0;
+
+        ParitySums& operator+=(const ParitySums& other)
+        {
+            even += other.even;
+            odd += other.odd;
+            return *this;
+        }
+    };
+    ParitySums sums = this->pool->ParallelSum<ParitySums>(this->stateVec.size(), [&](std::size_t begin, std::size_t end) {
+        ParitySums partial;
+        for (std::size_t i = begin; i < end; i++)
+            (Parity(i & parityMask) ? partial.odd : partial.even) += std::norm(amps[i]);
+        return partial;
+    });
+    double probZero = sums.even / (sums.even + sums.odd);
 
     // Select measurement outcome via PRNG.
-    double random0to1 = (double) rand() / (RAND_MAX);
+    double random0to1 = this->rng.NextDouble();
     Result outcome = random0to1 < probZero ? UseZero() : UseOne();
 
-    // Update state vector with |Ψ'⟩ = 1/√p(m) P_m|Ψ⟩.
-    if (outcome == UseZero())
-        this->stateVec = (p_projector * this->stateVec)/sqrt(probZero);
-    else
-        this->stateVec = (m_projector * this->stateVec)/sqrt(1-probZero);
+    // Update state vector with |Ψ'⟩ = 1/√p(m) P_m|Ψ⟩ in a single pass.
+    bool oddParity = (outcome == UseOne());
+    double factor = 1/sqrt(oddParity ? sums.odd : sums.even);
+    this->pool->ParallelFor(this->stateVec.size(), [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; i++)
+            amps[i] = (Parity(i & parityMask) == oddParity) ? amps[i] * Precision(factor) : Amplitude(0);
+    });
 
+    RotateBasis(numBases, bases, targets, /*toComputational=*/false);
     return outcome;
 }
 
-Operator StateSimulator::BuildPauliUnitary(long numTargets, PauliId paulis[], Qubit targets[])
+template <typename Precision>
+Result StateSimulator<Precision>::DeferMeasurement(long numBases, PauliId bases[], Qubit targets[])
 {
-    // Sort pauli matrices by the target qubit's index in the compute register.
-    std::vector<std::pair<short, PauliId>> sortedTargetBase(numTargets);
-    for (int i = 0; i < numTargets; i++)
-        sortedTargetBase.push_back({GetQubitIdx(targets[i]), paulis[i]});
-    std::sort(sortedTargetBase.begin(), sortedTargetBase.end(),
-              [](std::pair<short, PauliId> x, std::pair<short, PauliId> y) {
-              return x.first < y.first;
+    // Rotating a qubit into the eigenbasis of its Pauli operator for good is fine, since it won't be acted on
+    // anymore. A qubit can be measured again in the same basis, but not in a basis that doesn't commute with it.
+    std::vector<Qubit> measured;
+    for (long i = 0; i < numBases; i++) {
+        if (bases[i] == PauliId_I)
+            continue;
+        std::size_t id = this->qbm->GetQubitId(targets[i]);
+        if (id >= this->measuredBases.size())
+            this->measuredBases.resize(id + 1, PauliId_I);
+
+        std::size_t mask = GetQubitMask(targets[i]);
+        if (this->measuredMask & mask) {
+            if (this->measuredBases[id] != bases[i])
+                throw std::logic_error("non_terminal_measurement");
+        } else {
+            RotateBasis(1, &bases[i], &targets[i], /*toComputational=*/true);
+            this->measuredBases[id] = bases[i];
+            this->measuredMask |= mask;
+        }
+        measured.push_back(targets[i]);
+    }
+    this->deferredMeasurements.push_back(std::move(measured));
+
+    // The result is only known once sampled, see AreEqualResults and GetResultValue.
+    return UseZero();
+}
+
+template <typename Precision>
+std::map<std::string, std::size_t> StateSimulator<Precision>::SampleMeasurements(std::size_t shots)
+{
+    Densify();
+    FlushGates();
+    std::vector<std::size_t> parityMasks;
+    for (const std::vector<Qubit>& measured : this->deferredMeasurements) {
+        std::size_t parityMask = 0;
+        for (Qubit q : measured)
+            parityMask |= GetQubitMask(q);
+        parityMasks.push_back(parityMask);
+    }
+
+    // Sorting the random numbers lets a single pass over the cumulative probabilities of the basis states
+    // pick the basis state of every shot, without storing the cumulative sums.
+    const Amplitude* amps = this->stateVec.data();
+    double norm = this->pool->ParallelSum(this->stateVec.size(), [&](std::size_t begin, std::size_t end) {
+        double sum = 0.0;
+        for (std::size_t i = begin; i < end; i++)
+            sum += std::norm(amps[i]);
+        return sum;
     });
+    std::vector<double> randoms(shots);
+    for (double& random0to1 : randoms)
+        random0to1 = norm * this->rng.NextDouble();
+    std::sort(randoms.begin(), randoms.end());
+
+    std::map<std::string, std::size_t> histogram;
+    std::size_t shot = 0;
+    double cumulative = 0.0;
+    for (std::size_t i = 0; i < this->stateVec.size() && shot < shots; i++) {
+        cumulative += std::norm(amps[i]);
+        std::size_t count = 0;
+        while (shot < shots && (randoms[shot] < cumulative || i == this->stateVec.size() - 1)) {
+            shot++;
+            count++;
+        }
+        if (count == 0)
+            continue;
+
+        std::string results;
+        for (std::size_t parityMask : parityMasks)
+            results += Parity(i & parityMask) ? '1' : '0';
+        histogram[results] += count;
+    }
+    return histogram;
+}
 
-    Operator pauliUnitary = Operator::Ones(1,1);
-    for (int i = 0, targetIdx = 0; i < this->numActiveQubits; i++) {
-        Pauli p_i = SelectPauliOp(i == sortedTargetBase[targetIdx].first ?
-                                  sortedTargetBase[targetIdx++].second :
-                                  PauliId_I);
-        pauliUnitary = kroneckerProduct(pauliUnitary, p_i).eval();
+template <typename Precision>
+std::size_t StateSimulator<Precision>::RotateBasis(long numTargets, PauliId bases[], Qubit targets[], bool toComputational)
+{
+    // X = H Z H and Y = (SH) Z (SH)†, so applying H (or HS†) maps the eigenbasis of X (or Y) to that of Z.
+    static const Gate h = (Gate() << 1, 1, 1, -1).finished() / sqrt(2);
+    GateKernelArgs<Precision> hadamard = MakeKernelArgs(GateKernelType_General, h);
+    GateKernelArgs<Precision> phase = MakeKernelArgs(GateKernelType_Diagonal,
+                                                     (Gate() << 1, 0, 0, toComputational ? -1i : 1i).finished());
+
+    std::size_t parityMask = 0;
+    for (long i = 0; i < numTargets; i++) {
+        if (bases[i] == PauliId_I)
+            continue;
+        std::size_t mask = GetQubitMask(targets[i]);
+        parityMask |= mask;
+        hadamard.targetMask = phase.targetMask = mask;
+        if (bases[i] == PauliId_Y && toComputational)
+            RunGateKernel(phase);
+        if (bases[i] != PauliId_Z)
+            RunGateKernel(hadamard);
+        if (bases[i] == PauliId_Y && !toComputational)
+            RunGateKernel(phase);
     }
+    return parityMask;
+}
+
+template <typename Precision>
+void StateSimulator<Precision>::ApplyPauliRotation(long numControls, Qubit controls[],
+                                        long numTargets, PauliId paulis[], Qubit targets[], double theta)
+{
+    // Rotations that don't flip any qubits only multiply the classical basis state by a phase.
+    if (this->classical) {
+        if (!AreClassicalControlsSet(numControls, controls))
+            return;
+        if (std::all_of(paulis, paulis + numTargets, [](PauliId p) { return p == PauliId_I || p == PauliId_Z; })) {
+            bool oddParity = false;
+            for (long i = 0; i < numTargets; i++)
+                if (paulis[i] == PauliId_Z)
+                    oddParity ^= GetClassicalBit(GetQubitIdx(targets[i]));
+            this->classicalPhase *= std::exp((oddParity ? -1i : 1i) * theta);
+            return;
+        }
+        Densify();
+    }
+
+    PauliKernelArgs<Precision> args = {};
+    args.amps = this->stateVec.data();
+    args.theta = theta;
+    for (long i = 0; i < numTargets; i++) {
+        std::size_t mask = GetQubitMask(targets[i]);
+        if (paulis[i] == PauliId_X || paulis[i] == PauliId_Y)
+            args.flipMask |= mask;
+        if (paulis[i] == PauliId_Z || paulis[i] == PauliId_Y)
+            args.phaseMask |= mask;
+        if (paulis[i] == PauliId_Y)
+            args.numY++;
+    }
+    for (long i = 0; i < numControls; i++)
+        args.controlMask |= GetQubitMask(controls[i]);
+
+    CheckNotMeasured(args.flipMask | args.phaseMask | args.controlMask);
 
-    return pauliUnitary;
+    // Queued gates on other qubits commute with the rotation and can stay queued.
+    FlushGates(args.flipMask | args.phaseMask | args.controlMask);
+
+    // Each pair (i, i ^ flipMask) is counted once by fixing the lowest flipped bit to 0.
+    std::size_t fixedMask = args.controlMask | (args.flipMask & (~args.flipMask + 1));
+    std::vector<std::size_t> fixedBits;
+    for (std::size_t mask = 1; mask != 0 && mask <= fixedMask; mask <<= 1)
+        if (fixedMask & mask)
+            fixedBits.push_back(mask);
+    args.fixedBits = fixedBits.data();
+    args.numFixedBits = fixedBits.size();
+
+    this->pool->ParallelFor(this->stateVec.size() >> fixedBits.size(), [&](std::size_t begin, std::size_t end) {
+        ApplyPauliKernel(args, begin, end);
+    });
 }
+
+
+// The class itself is instantiated in RuntimeManagement.cpp, which only covers the members defined there.
+#define INSTANTIATE_STATE_SIMULATION(Precision) \
+    template void StateSimulator<Precision>::UpdateState(short, bool); \
+    template void StateSimulator<Precision>::Densify(); \
+    template void StateSimulator<Precision>::ApplyGate(Gate, Qubit); \
+    template void StateSimulator<Precision>::ApplyControlledGate(Gate, long, Qubit[], Qubit); \
+    template void StateSimulator<Precision>::ApplyDiagonalGate(std::complex<double>, std::complex<double>, long, Qubit[], Qubit); \
+    template void StateSimulator<Precision>::ApplyPermutationGate(std::complex<double>, std::complex<double>, long, Qubit[], Qubit); \
+    template void StateSimulator<Precision>::RunGateKernel(GateKernelArgs<Precision>); \
+    template void StateSimulator<Precision>::X(Qubit); \
+    template void StateSimulator<Precision>::ControlledX(long, Qubit[], Qubit); \
+    template void StateSimulator<Precision>::Y(Qubit); \
+    template void StateSimulator<Precision>::ControlledY(long, Qubit[], Qubit); \
+    template void StateSimulator<Precision>::Z(Qubit); \
+    template void StateSimulator<Precision>::ControlledZ(long, Qubit[], Qubit); \
+    template void StateSimulator<Precision>::H(Qubit); \
+    template void StateSimulator<Precision>::ControlledH(long, Qubit[], Qubit); \
+    template void StateSimulator<Precision>::S(Qubit); \
+    template void StateSimulator<Precision>::ControlledS(long, Qubit[], Qubit); \
+    template void StateSimulator<Precision>::AdjointS(Qubit); \
+    template void StateSimulator<Precision>::ControlledAdjointS(long, Qubit[], Qubit); \
+    template void StateSimulator<Precision>::T(Qubit); \
+    template void StateSimulator<Precision>::ControlledT(long, Qubit[], Qubit); \
+    template void StateSimulator<Precision>::AdjointT(Qubit); \
+    template void StateSimulator<Precision>::ControlledAdjointT(long, Qubit[], Qubit); \
+    template void StateSimulator<Precision>::R(PauliId, Qubit, double); \
+    template void StateSimulator<Precision>::ControlledR(long, Qubit[], PauliId, Qubit, double); \
+    template void StateSimulator<Precision>::Exp(long, PauliId[], Qubit[], double); \
+    template void StateSimulator<Precision>::ControlledExp(long, Qubit[], long, PauliId[], Qubit[], double); \
+    template Result StateSimulator<Precision>::Measure(long, PauliId[], long, Qubit[]); \
+    template Result StateSimulator<Precision>::DeferMeasurement(long, PauliId[], Qubit[]); \
+    template std::map<std::string, std::size_t> StateSimulator<Precision>::SampleMeasurements(std::size_t); \
+    template std::size_t StateSimulator<Precision>::RotateBasis(long, PauliId[], Qubit[], bool); \
+    template void StateSimulator<Precision>::ApplyPauliRotation(long, Qubit[], long, PauliId[], Qubit[], double);
+
+namespace Microsoft
+{
+namespace Quantum
+{
+    INSTANTIATE_STATE_SIMULATION(float)
+    INSTANTIATE_STATE_SIMULATION(double)
+
+} // namespace Quantum
+} // namespace Microsoft
@@ -1,7 +1,12 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT License.
 
+#include <complex>
+#include <cstddef>
 #include <cstdlib>
+#include <map>
+#include <memory>
+#include <stdexcept>
 #include <vector>
 #include <algorithm>
 #include <string>
@@ -10,10 +15,13 @@
 #include "QSharpSimApi_I.hpp"
 
 #include "QubitManager.hpp"
+#include "ThreadPool.hpp"
+#include "GateKernels.hpp"
+#include "StateBuffer.hpp"
+#include "Random.hpp"
 
 #include "Eigen/Dense"
 
-using State = Eigen::VectorXcd;
 using Gate = Eigen::Matrix2cd;
 using Pauli = Eigen::Matrix2cd;
 using Operator = Eigen::MatrixXcd;
@@ -22,18 +30,119 @@ namespace Microsoft
 {
 namespace Quantum
 {
-    class StateSimulator : public IRuntimeDriver, public IQuantumGateSet
+    struct StateSimulatorSettings
     {
+        // Number of threads used to update the state vector, including the calling thread.
+        // When 0, the QIR_SIMULATOR_THREADS environment variable is used if set, otherwise
+        // the number of hardware threads.
+        unsigned numThreads = 0;
+
+        // Maximum number of qubits a fused gate may act on (at most MatrixKernelMaxQubits).
+        // Consecutive gates are multiplied into one matrix as long as they fit, so that the state vector is only
+        // swept once for all of them. Setting this to 0 disables gate fusion.
+        unsigned fusionWidth = 2;
+
+        // Maximum number of gates held back before all queued gates are applied to the state vector.
+        unsigned fusionDepth = 64;
+
+        // Size in bytes of the blocks the state vector is split into when applying queued gates, which should fit
+        // into the L2 cache of a core. Consecutive gates that only mix amplitudes within a block are applied to one
+        // block after the other, so that the state vector is only swept once for all of them. Qubits that many queued
+        // gates act on are moved into the bits addressing a block. Setting this to 0 disables cache blocking.
+        std::size_t cacheBlockBytes = 256 * 1024;
+
+        // Number of qubits to reserve memory for up front. The state vector can still grow past it,
+        // but growing within the reserved capacity never moves the amplitudes.
+        unsigned reservedQubits = 0;
+
+        // Whether to ask the OS to back large state vectors with transparent huge pages (Linux only).
+        bool hugePages = true;
+
+        // Path of a file to keep the state vector in instead of memory (Linux only), which should be on fast local
+        // storage and must not exist yet. The file is mapped into memory and swept sequentially, so that the state
+        // vector can exceed RAM. Each pass over the state vector then reads and writes the whole file, so
+        // cacheBlockBytes should be raised such that one block per thread still fits into RAM (e.g. 64 MiB), which
+        // lets more gates share a pass while the blocks are still split between all threads.
+        std::string backingFile;
+
+        // Whether measurements are deferred, so that many shots can be sampled from a single simulation with
+        // SampleMeasurements. Measurements must then be terminal: measured qubits can't be acted on anymore,
+        // and their results can't be inspected during the simulation.
+        bool deferMeasurements = false;
+
+        // Random number stream to draw measurement outcomes from. Simulators with the same seed but different
+        // streams produce independent outcomes, so that shots can be split between simulators running in parallel.
+        // Selecting stream k advances the generator by k * 2^128 steps at construction.
+        uint64_t randomStream = 0;
+
+        // Whether to track the state as a single basis state with a phase for as long as only classical gates
+        // (X, CNOT, Toffoli and other gates that map basis states to basis states) and measurements in the
+        // computational basis are applied. The full state vector is only built on the first other operation,
+        // so that reversible circuits on any number of qubits take time linear in the number of gates.
+        // Until then, DumpMachine prints the tracked basis state instead of the list of all amplitudes.
+        bool classicalStart = false;
+    };
+
+    // A product of Pauli operators on the given qubits, such as one term of a Hamiltonian.
+    struct PauliTerm
+    {
+        std::vector<PauliId> paulis;
+        std::vector<Qubit> targets;
+    };
+
+    // The simulator is available in single (float) and double precision. Single precision halves the memory
+    // and bandwidth needed for the state vector, while gate matrices are still built in double precision.
+    template <typename Precision = double>
+    class StateSimulator : public IRuntimeDriver, public IQuantumGateSet, public IDiagnostics
+    {
+        using Amplitude = std::complex<Precision>;
+        using State = StateBuffer<Precision>;
+
         // Associated qubit manager instance to handle qubit representation.
         CQubitManager *qbm;
 
-        // The register of currently active qubits.
+        // Worker threads to split loops over the state vector between.
+        ThreadPool *pool;
+
+        // The register of currently active qubits, where computeRegister[b] is stored in bit b of the state index,
+        // and the position of each active qubit in it, indexed by its qubit manager ID.
         short numActiveQubits = 0;
         std::vector<Qubit> computeRegister;
+        std::vector<short> qubitPositions;
 
         // The state of the compute register is represented by its full 2^n column vector of probability amplitudes.
         // With no qubits allocated, the state vector starts out as the scalar 1.
-        State stateVec = State::Ones(1);
+        State stateVec;
+
+        // While `classical` is set, the state is the basis state with bit b of classicalBits for computeRegister[b],
+        // multiplied by classicalPhase. The state vector then stays at size 1 until Densify() builds it.
+        bool classical;
+        std::vector<uint64_t> classicalBits;
+        std::complex<double> classicalPhase = 1;
+
+        bool GetClassicalBit(short position) const
+        {
+            return (this->classicalBits[position / 64] >> (position % 64)) & 1;
+        }
+
+        void FlipClassicalBit(short position)
+        {
+            this->classicalBits[position / 64] ^= uint64_t(1) << (position % 64);
+        }
+
+        bool AreClassicalControlsSet(long numControls, Qubit controls[])
+        {
+            for (long i = 0; i < numControls; i++)
+                if (!GetClassicalBit(GetQubitIdx(controls[i])))
+                    return false;
+            return true;
+        }
+
+        // Builds the state vector from the classical basis state, leaving classical mode for good.
+        void Densify();
+
+        // Source of randomness for measurement outcomes, owned by this instance only.
+        Xoshiro256PlusPlus rng;
 
         // To be called on allocation/deallocation of qubits to update the state vector.
         void UpdateState(short qubitIndex, bool remove = false);
@@ -42,29 +151,174 @@ namespace Quantum
         void ApplyGate(Gate gate, Qubit target);
         void ApplyControlledGate(Gate gate, long numControls, Qubit controls[], Qubit target);
 
-        // Builds a unitary matrix over the state space made of Pauli operators.
-        Operator BuildPauliUnitary(long numTargets, PauliId paulis[], Qubit targets[]);
+        // Fast paths for gates that only multiply each basis state by a phase (diagonal gates),
+        // or that flip the target up to a phase (permutation gates), touching each amplitude at most once.
+        void ApplyDiagonalGate(std::complex<double> phase0, std::complex<double> phase1,
+                               long numControls, Qubit controls[], Qubit target);
+        void ApplyPermutationGate(std::complex<double> phase01, std::complex<double> phase10,
+                                  long numControls, Qubit controls[], Qubit target);
+
+        // Fills in the target and control masks, then queues the gate for fusion.
+        void QueueGate(GateKernelArgs<Precision> args, long numControls, Qubit controls[], Qubit target);
+
+        // Runs the gate kernel over all amplitude pairs of the target whose control bits are set.
+        void RunGateKernel(GateKernelArgs<Precision> args);
+
+        static GateKernelArgs<Precision> MakeKernelArgs(GateKernelType type, const Gate& gate)
+        {
+            GateKernelArgs<Precision> args = {};
+            args.type = type;
+            for (int row = 0; row < 2; row++)
+                for (int col = 0; col < 2; col++)
+                    args.gate[row][col] = Amplitude(gate(row, col));
+            return args;
+        }
+
+        // Gates which have been queued but not yet applied to the state vector. Each entry acts on a disjoint
+        // set of qubits, so that the entries commute and can be applied in any order.
+        struct FusedGate
+        {
+            // Mask of the qubits acted on, and the matrix acting on them where bit j of the matrix index
+            // corresponds to the j-th lowest bit of the mask. The matrix is only built once a second gate
+            // is fused into the first one.
+            std::size_t qubitMask;
+            Operator matrix;
+
+            // The first gate that was queued, which is run with its own kernel if nothing was fused into it.
+            GateKernelArgs<Precision> first;
+            std::size_t numGates;
+        };
+        std::vector<FusedGate> fusedGates;
+        unsigned fusionWidth;
+        unsigned fusionDepth;
+        std::size_t numQueuedGates = 0;
+        std::size_t numSweepsSaved = 0;
+
+        // Entries taken off the queue, in the order they have to be applied in. Runs of consecutive entries that
+        // only mix amplitudes within blocks of 2^blockQubits amplitudes are applied one block at a time.
+        std::vector<FusedGate> gateBatch;
+        unsigned blockQubits;
+
+        // A queued entry with its kernel arguments filled in, ready to be applied to the whole state vector or to
+        // a single block. Controls outside of the block are left out of the arguments and checked per block.
+        struct PreparedGate
+        {
+            bool isMatrix;
+            GateKernelArgs<Precision> args;
+            Eigen::Matrix<Amplitude, Eigen::Dynamic, Eigen::Dynamic> matrix;
+            std::vector<std::size_t> fixedBits;
+            std::size_t outerControls;
+        };
+        PreparedGate PrepareGate(const FusedGate& fused, std::size_t blockMask);
+        static void RunPreparedGate(const PreparedGate& prepared, Amplitude* amps, std::size_t begin, std::size_t end);
+
+        // With deferred measurements, each measured qubit is rotated into the eigenbasis of its Pauli operator
+        // once and then left alone, and each measurement is recorded as the set of qubits whose parity it reads.
+        // Measured qubits aren't removed from the state vector when released.
+        bool deferMeasurements;
+        std::size_t measuredMask = 0;
+        std::vector<PauliId> measuredBases;
+        std::vector<std::vector<Qubit>> deferredMeasurements;
+
+        Result DeferMeasurement(long numBases, PauliId bases[], Qubit targets[]);
+
+        // Throws if any of the given qubits has been measured with deferred measurements.
+        void CheckNotMeasured(std::size_t qubitMask)
+        {
+            if (qubitMask & this->measuredMask)
+                throw std::logic_error("non_terminal_measurement");
+        }
+
+        // Applies the queued gates acting on any of the given qubits (by default all of them) to the state vector.
+        // Must be called before anything reads the state vector or changes how qubits map to its bits.
+        void FlushGates(std::size_t qubitMask = ~std::size_t(0));
+        void RunFusedGate(const FusedGate& fused);
+
+        // Moves the queued gates acting on any of the given qubits to the end of the batch, without applying them.
+        void RetireGates(std::size_t qubitMask);
+
+        // Applies all gates in the batch to the state vector, running each entry that only mixes amplitudes within
+        // blocks together with its neighbors, block by block. With `remap`, qubits may be moved to other bits first.
+        void RunGateBatch(bool remap = false);
+        void RunBlockedGates(std::size_t first, std::size_t last);
+
+        // Applies all queued gates once the queue is full, which is the only time qubits are moved to other bits.
+        void RunQueuedGates();
+
+        // Swaps qubits between the bits addressing a block and the higher bits, where it saves passes over the state
+        // vector for the batch. The queue must be empty, since the batch is the only place updated to the new bits.
+        void RemapForBlocking();
+        void SwapQubitPositions(short low, short high);
+
+        // Rotates each target qubit from the eigenbasis of its Pauli operator to the computational basis, or back.
+        // Returns the mask of all qubits with a Pauli operator other than the identity.
+        std::size_t RotateBasis(long numTargets, PauliId bases[], Qubit targets[], bool toComputational);
+
+        // Applies exp(iθP) for the Pauli string P over the targets in a single pass, controlled on the given qubits.
+        void ApplyPauliRotation(long numControls, Qubit controls[],
+                                long numTargets, PauliId paulis[], Qubit targets[], double theta);
+
+        static unsigned ResolveNumThreads(unsigned requested)
+        {
+            if (requested > 0)
+                return requested;
+            if (const char* env = std::getenv("QIR_SIMULATOR_THREADS"))
+                if (int fromEnv = std::atoi(env); fromEnv > 0)
+                    return fromEnv;
+            return std::max(1u, std::thread::hardware_concurrency());
+        }
 
+        // New qubits take the next most significant bit of the state index. A released qubit's bit is taken over
+        // by the most significant one, so that positions stay contiguous without reordering other qubits.
         short GetQubitIdx(Qubit q)
         {
-            return std::distance(
-                this->computeRegister.begin(),
-                std::find(this->computeRegister.begin(), this->computeRegister.end(), q)
-            );
+            return this->qubitPositions[this->qbm->GetQubitId(q)];
+        }
+
+        std::size_t GetQubitMask(Qubit q)
+        {
+            return std::size_t(1) << GetQubitIdx(q);
         }
 
       public:
-        StateSimulator(uint32_t userProvidedSeed = 0)
+        StateSimulator(uint32_t userProvidedSeed = 0, StateSimulatorSettings settings = {})
+            : stateVec(settings.reservedQubits, settings.hugePages, settings.backingFile)
+            , rng(userProvidedSeed, settings.randomStream)
         {
-            srand(userProvidedSeed);
             this->qbm = new CQubitManager();
+            this->pool = new ThreadPool(ResolveNumThreads(settings.numThreads));
+            this->fusionWidth = std::min<unsigned>(settings.fusionWidth, MatrixKernelMaxQubits);
+            this->fusionDepth = std::max(1u, settings.fusionDepth);
+            this->blockQubits = 0;
+            while ((sizeof(Amplitude) << (this->blockQubits + 1)) <= settings.cacheBlockBytes)
+                this->blockQubits++;
+            this->deferMeasurements = settings.deferMeasurements;
+            this->classical = settings.classicalStart;
         }
         ~StateSimulator()
         {
+            delete this->pool;
             delete this->qbm;
         }
 
 
+        // Number of passes over the state vector avoided so far by fusing gates.
+        std::size_t GetNumSweepsSaved() const
+        {
+            return this->numSweepsSaved;
+        }
+
+        // Draws the given number of shots from the current state for all deferred measurements, without changing it.
+        // Returns how often each combination of results occurred, as a string of '0's and '1's in measurement order.
+        std::map<std::string, std::size_t> SampleMeasurements(std::size_t shots);
+
+        // Returns the expectation value ⟨Ψ|P|Ψ⟩ of the Pauli string P over the targets, without changing the state.
+        double Expectation(long numTargets, PauliId paulis[], Qubit targets[]);
+
+        // Returns the expectation values of all terms, computed together in a single pass over the state vector.
+        std::vector<double> Expectations(const std::vector<PauliTerm>& terms);
+
+
         ///
         /// Implementation of IRuntimeDriver
         ///
@@ -147,5 +401,13 @@ namespace Quantum
 
     }; // class StateSimulator
 
+    extern template class StateSimulator<float>;
+    extern template class StateSimulator<double>;
+
+    // Creates a state simulator with the given precision (float or double).
+    template <typename Precision = double>
+    std::unique_ptr<IRuntimeDriver> CreateStateSimulator(uint32_t userProvidedSeed = 0,
+                                                         StateSimulatorSettings settings = {});
+
 } // namespace Quantum
 } // namespace Microsoft
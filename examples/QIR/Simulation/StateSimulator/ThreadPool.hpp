@@ -0,0 +1,154 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Microsoft
+{
+namespace Quantum
+{
+    // Persistent pool of worker threads used to partition loops over the state vector.
+    // The calling thread always takes part in the work, so a pool of size 1 runs everything serially.
+    class ThreadPool
+    {
+        // Loops over fewer amplitudes than this are run on the calling thread only,
+        // since waking up the workers would cost more than the work itself.
+        static constexpr std::size_t serialThreshold = std::size_t(1) << 14;
+
+        // Number of chunks handed out per thread, to balance uneven progress between threads.
+        static constexpr std::size_t chunksPerThread = 4;
+
+        std::vector<std::thread> workers;
+
+        std::mutex mutex;
+        std::condition_variable workAvailable;
+        std::condition_variable workDone;
+        uint64_t generation = 0;
+        unsigned busyWorkers = 0;
+        bool stopping = false;
+
+        // The loop currently being executed, split into `numChunks` chunks of `chunkSize` elements.
+        std::function<void(std::size_t, std::size_t, std::size_t)> body;
+        std::size_t count = 0;
+        std::size_t chunkSize = 0;
+        std::size_t numChunks = 0;
+        std::atomic<std::size_t> nextChunk{0};
+
+        void RunChunks()
+        {
+            for (std::size_t chunk = nextChunk++; chunk < this->numChunks; chunk = nextChunk++) {
+                std::size_t begin = chunk * this->chunkSize;
+                this->body(chunk, begin, std::min(begin + this->chunkSize, this->count));
+            }
+        }
+
+        void WorkerLoop()
+        {
+            uint64_t seenGeneration = 0;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(this->mutex);
+                    this->workAvailable.wait(lock, [&] { return this->stopping || this->generation != seenGeneration; });
+                    if (this->stopping)
+                        return;
+                    seenGeneration = this->generation;
+                }
+
+                RunChunks();
+
+                std::lock_guard<std::mutex> lock(this->mutex);
+                if (--this->busyWorkers == 0)
+                    this->workDone.notify_one();
+            }
+        }
+
+        // Runs body(chunk, begin, end) over all chunks of [0, count) and returns the number of chunks used.
+        // Each element stands for `itemSize` amplitudes when deciding whether the loop is worth splitting.
+        std::size_t Run(std::size_t count, std::size_t itemSize,
+                        std::function<void(std::size_t, std::size_t, std::size_t)> body)
+        {
+            if (this->workers.empty() || count < 2 || count * itemSize < serialThreshold) {
+                body(0, 0, count);
+                return 1;
+            }
+
+            std::size_t chunks = std::min(count, Size() * chunksPerThread);
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->body = std::move(body);
+                this->count = count;
+                this->chunkSize = (count + chunks - 1) / chunks;
+                this->numChunks = (count + this->chunkSize - 1) / this->chunkSize;
+                this->nextChunk = 0;
+                this->busyWorkers = this->workers.size();
+                this->generation++;
+            }
+            this->workAvailable.notify_all();
+
+            RunChunks();
+
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->workDone.wait(lock, [&] { return this->busyWorkers == 0; });
+            return this->numChunks;
+        }
+
+      public:
+        explicit ThreadPool(unsigned numThreads)
+        {
+            for (unsigned i = 1; i < numThreads; i++)
+                this->workers.emplace_back(&ThreadPool::WorkerLoop, this);
+        }
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->stopping = true;
+            }
+            this->workAvailable.notify_all();
+            for (std::thread& worker : this->workers)
+                worker.join();
+        }
+
+        // Total number of threads, including the calling thread.
+        std::size_t Size() const
+        {
+            return this->workers.size() + 1;
+        }
+
+        // Calls body(begin, end) on disjoint ranges covering [0, count), possibly in parallel.
+        // Loops whose elements are larger units of work, such as whole blocks of amplitudes, pass their size
+        // as `itemSize`, so that they are split between threads even when there are only a few of them.
+        template <typename F>
+        void ParallelFor(std::size_t count, F&& body, std::size_t itemSize = 1)
+        {
+            Run(count, itemSize, [&body](std::size_t, std::size_t begin, std::size_t end) { body(begin, end); });
+        }
+
+        // Sums body(begin, end) over disjoint ranges covering [0, count), where T is any type with a += operator
+        // whose value-initialized state is zero. The partial sums are always combined in the same order,
+        // so the result does not depend on thread scheduling.
+        template <typename T = double, typename F>
+        T ParallelSum(std::size_t count, F&& body)
+        {
+            std::vector<T> partialSums(std::min(count, Size() * chunksPerThread) + 1, T{});
+            std::size_t chunks = Run(count, 1, [&](std::size_t chunk, std::size_t begin, std::size_t end) {
+                partialSums[chunk] = body(begin, end);
+            });
+
+            T sum = T{};
+            for (std::size_t chunk = 0; chunk < chunks; chunk++)
+                sum += partialSums[chunk];
+            return sum;
+        }
+    };
+
+} // namespace Quantum
+} // namespace Microsoft
@@ -0,0 +1,107 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+// Measures the time per traced gate for each output of the trace simulator, and counts the heap allocations made
+// while tracing by replacing the global operator new. A mix of single-qubit, controlled and rotation gates is traced,
+// with an occasional long Exp and multi-qubit measurement, whose qubit lists spill out of the inline record. Tracing
+// shouldn't allocate once the spill buffers have grown, so the number of allocations is expected to be zero.
+//
+// Usage: AllocationBenchmark [numIterations = 1000000] [traceFile = trace.bin] [textFile = trace.txt]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include "TraceSimulator.hpp"
+
+using namespace Microsoft::Quantum;
+
+static std::size_t numAllocations = 0;
+
+void* operator new(std::size_t size)
+{
+    numAllocations++;
+    if (void* p = std::malloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+static void Run(const char* name, TraceSimulatorSettings settings, long numIterations)
+{
+    settings.writeSummary = false;
+    TraceSimulator sim(settings);
+    std::vector<Qubit> q;
+    for (int i = 0; i < 50; i++)
+        q.push_back(sim.AllocateQubit());
+    const PauliId paulis[4] = {PauliId_I, PauliId_X, PauliId_Z, PauliId_Y};
+    std::vector<PauliId> p;
+    for (int i = 0; i < 40; i++)
+        p.push_back(paulis[(i * 7) % 4]);
+
+    // Grow the spill buffers before counting.
+    sim.ControlledExp(3, &q[40], 40, p.data(), q.data(), 0.5);
+    std::size_t allocationsBefore = numAllocations;
+
+    std::size_t numGates = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long k = 0; k < numIterations; k++) {
+        sim.T(q[k % 50]);
+        sim.ControlledX(2, &q[(k + 1) % 48], q[(k + 7) % 50]);
+        sim.R(PauliId_Y, q[k % 50], 0.125 * k);
+        numGates += 3;
+        if (k % 100 == 0) {
+            sim.ControlledExp(3, &q[40], 40, p.data(), q.data(), 0.001 * k);
+            numGates++;
+        }
+        if (k % 50 == 0) {
+            sim.Measure(3, p.data(), 3, &q[k % 47]);
+            numGates++;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::size_t allocations = numAllocations - allocationsBefore;
+
+    std::fprintf(stderr, "%-9s %9zu gates: %6.1f ns/gate, %zu heap allocations\n", name, numGates,
+                 seconds / numGates * 1e9, allocations);
+}
+
+int main(int argc, char* argv[])
+{
+    long numIterations = argc > 1 ? std::atol(argv[1]) : 1000000;
+    const char* traceFile = argc > 2 ? argv[2] : "trace.bin";
+    const char* textFile = argc > 3 ? argv[3] : "trace.txt";
+
+    // The text trace goes to the standard output, which is redirected to a file so that the terminal doesn't slow it
+    // down.
+    std::ofstream text(textFile);
+    std::streambuf* console = std::cout.rdbuf(text.rdbuf());
+    Run("text", {}, numIterations / 10);
+    std::cout.rdbuf(console);
+
+    TraceSimulatorSettings binary;
+    binary.output = TraceOutput_Binary;
+    binary.outputFile = traceFile;
+    Run("binary", binary, numIterations);
+
+    binary.backgroundWriter = true;
+    Run("async", binary, numIterations);
+
+    TraceSimulatorSettings resources;
+    resources.output = TraceOutput_Resources;
+    Run("resources", resources, numIterations);
+    return 0;
+}
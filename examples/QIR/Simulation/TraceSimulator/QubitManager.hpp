@@ -1,6 +1,8 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT License.
 
+#pragma once
+
 #include "CoreTypes.hpp"
 
 namespace Microsoft
@@ -12,13 +14,13 @@ namespace Quantum
         // Keep track of unique qubit ids via simple counter.
         uint64_t nextQubitId = 0;
 
+      public:
         // Get the internal ID associated to a qubit object.
         static uint64_t GetQubitId(Qubit qubit)
         {
             return reinterpret_cast<uint64_t>(qubit);
         }
 
-      public:
         Qubit AllocateQubit()
         {
             return reinterpret_cast<Qubit>(this->nextQubitId++);
@@ -0,0 +1,149 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "QubitManager.hpp"
+#include "TraceFormat.hpp"
+
+namespace Microsoft
+{
+namespace Quantum
+{
+    // Resources used by a traced program.
+    struct ResourceCounts
+    {
+        // Number of operations with each opcode, without and with controls.
+        uint64_t gates[TraceOpcode_Count] = {};
+        uint64_t controlledGates[TraceOpcode_Count] = {};
+
+        // Number of (uncontrolled) T and adjoint T gates, and the number of layers they can be arranged in.
+        uint64_t tCount = 0;
+        uint64_t tDepth = 0;
+
+        // Number of layers of operations, where operations in a layer act on disjoint qubits.
+        uint64_t depth = 0;
+
+        // Largest number of qubits allocated at the same time.
+        uint64_t peakQubits = 0;
+
+        // Adds the counts of another, independent run. Depths and peak qubits are those of the larger run.
+        void Merge(const ResourceCounts& other)
+        {
+            for (int op = 0; op < TraceOpcode_Count; op++) {
+                this->gates[op] += other.gates[op];
+                this->controlledGates[op] += other.controlledGates[op];
+            }
+            this->tCount += other.tCount;
+            this->tDepth = std::max(this->tDepth, other.tDepth);
+            this->depth = std::max(this->depth, other.depth);
+            this->peakQubits = std::max(this->peakQubits, other.peakQubits);
+        }
+
+        void WriteJson(std::ostream& out, const std::string& indent = "") const
+        {
+            auto writeCounts = [&](const uint64_t (&counts)[TraceOpcode_Count]) {
+                out << "{";
+                for (int op = 0; op < TraceOpcode_Count; op++)
+                    out << (op > 0 ? ", " : "") << "\"" << TraceOpcodeNames[op] << "\": " << counts[op];
+                out << "}";
+            };
+            std::string next = ",\n" + indent + "  ";
+            out << "{\n" << indent << "  \"gates\": ";
+            writeCounts(this->gates);
+            out << next << "\"controlledGates\": ";
+            writeCounts(this->controlledGates);
+            out << next << "\"tCount\": " << this->tCount
+                << next << "\"tDepth\": " << this->tDepth
+                << next << "\"depth\": " << this->depth
+                << next << "\"peakQubits\": " << this->peakQubits << "\n" << indent << "}";
+        }
+    };
+
+    // Counts the resources of a program as its operations are traced, without recording the operations themselves.
+    // Depths are tracked with the layer of the last operation (and of the last T gate) on each qubit, indexed by ID.
+    // Since nothing is traced, the counter hands out the qubit IDs itself and reuses those of released qubits, so
+    // that the layers take memory for the largest number of qubits allocated at the same time rather than for all
+    // qubits ever allocated.
+    class ResourceCounter
+    {
+        ResourceCounts counts;
+        std::vector<uint64_t> layers;
+        std::vector<uint64_t> tLayers;
+        std::vector<uint64_t> releasedIds;
+        uint64_t numLiveQubits = 0;
+
+      public:
+        Qubit AllocateQubit()
+        {
+            uint64_t id = this->layers.size();
+            if (this->releasedIds.empty()) {
+                this->layers.push_back(0);
+                this->tLayers.push_back(0);
+            }
+            else {
+                // A reused ID starts out like a new one.
+                id = this->releasedIds.back();
+                this->releasedIds.pop_back();
+                this->layers[id] = 0;
+                this->tLayers[id] = 0;
+            }
+            this->counts.peakQubits = std::max(this->counts.peakQubits, ++this->numLiveQubits);
+            return reinterpret_cast<Qubit>(id);
+        }
+
+        void ReleaseQubit(Qubit q)
+        {
+            this->releasedIds.push_back(QubitManager::GetQubitId(q));
+            this->numLiveQubits--;
+        }
+
+        // Counts an operation, putting it into the layer after the last one on any of its qubits. The qubits are
+        // taken as passed to the gate set, so that counting doesn't need to fill in a GateRecord first.
+        void Count(TraceOpcode opcode, long numControls, const Qubit controls[], long numTargets, const Qubit targets[])
+        {
+            (numControls > 0 ? this->counts.controlledGates : this->counts.gates)[opcode]++;
+
+            uint64_t layer = 0, tLayer = 0;
+            auto latest = [&](Qubit q) {
+                uint64_t id = QubitManager::GetQubitId(q);
+                layer = std::max(layer, this->layers[id] + 1);
+                tLayer = std::max(tLayer, this->tLayers[id]);
+            };
+            for (long i = 0; i < numControls; i++)
+                latest(controls[i]);
+            for (long i = 0; i < numTargets; i++)
+                latest(targets[i]);
+
+            if (numControls == 0 && (opcode == TraceOpcode_T || opcode == TraceOpcode_AdjointT)) {
+                this->counts.tCount++;
+                this->counts.tDepth = std::max(this->counts.tDepth, ++tLayer);
+            }
+            this->counts.depth = std::max(this->counts.depth, layer);
+
+            auto update = [&](Qubit q) {
+                uint64_t id = QubitManager::GetQubitId(q);
+                this->layers[id] = layer;
+                this->tLayers[id] = tLayer;
+            };
+            for (long i = 0; i < numControls; i++)
+                update(controls[i]);
+            for (long i = 0; i < numTargets; i++)
+                update(targets[i]);
+        }
+
+        const ResourceCounts& GetCounts() const
+        {
+            return this->counts;
+        }
+    };
+
+} // namespace Quantum
+} // namespace Microsoft
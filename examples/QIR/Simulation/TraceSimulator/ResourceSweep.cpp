@@ -0,0 +1,108 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "QirContext.hpp"
+
+#include "ResourceSweep.hpp"
+
+///
+/// Resource sweeps
+///
+
+namespace Microsoft
+{
+namespace Quantum
+{
+    ResourceReport RunResourceSweep(const std::vector<ResourceRun>& runs, unsigned numThreads)
+    {
+        if (numThreads == 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+        numThreads = std::min<std::size_t>(numThreads, std::max<std::size_t>(runs.size(), 1));
+
+        ResourceReport report;
+        report.runs.resize(runs.size());
+        std::atomic<std::size_t> nextRun{0};
+        std::exception_ptr error;
+        std::mutex errorMutex;
+
+        // Runs are handed out one at a time, since their sizes usually differ a lot. Each thread only writes to the
+        // slots of its own runs, so the counts are collected without locking.
+        auto worker = [&]() {
+            for (std::size_t run; (run = nextRun.fetch_add(1)) < runs.size();) {
+                try {
+                    TraceSimulatorSettings settings;
+                    settings.output = TraceOutput_Resources;
+                    settings.writeSummary = false;
+                    TraceSimulator sim(settings);
+
+                    // The Runtime keeps the current context in thread-local storage, so that each thread runs its
+                    // entry points against its own simulator.
+                    QirContextScope qirctx(&sim, false /*trackAllocatedObjects*/);
+                    runs[run].entryPoint();
+                    report.runs[run] = sim.GetResourceCounts();
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!error)
+                        error = std::current_exception();
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < numThreads; i++)
+            threads.emplace_back(worker);
+        worker();
+        for (std::thread& thread : threads)
+            thread.join();
+        if (error)
+            std::rethrow_exception(error);
+
+        for (const ResourceRun& run : runs)
+            report.names.push_back(run.name);
+        for (const ResourceCounts& counts : report.runs)
+            report.total.Merge(counts);
+        return report;
+    }
+
+    // Writes a string as a JSON string literal, escaping quotes, backslashes and control characters.
+    static void WriteJsonString(std::ostream& out, const std::string& text)
+    {
+        out << '"';
+        for (char c : text) {
+            if (c == '"' || c == '\\')
+                out << '\\' << c;
+            else if (static_cast<unsigned char>(c) < 0x20) {
+                char escape[8];
+                std::snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned char>(c));
+                out << escape;
+            }
+            else
+                out << c;
+        }
+        out << '"';
+    }
+
+    void ResourceReport::WriteJson(std::ostream& out) const
+    {
+        out << "{\n  \"runs\": {";
+        for (std::size_t run = 0; run < this->runs.size(); run++) {
+            out << (run > 0 ? "," : "") << "\n    ";
+            WriteJsonString(out, this->names[run]);
+            out << ": ";
+            this->runs[run].WriteJson(out, "    ");
+        }
+        out << "\n  },\n  \"total\": ";
+        this->total.WriteJson(out, "  ");
+        out << "\n}\n";
+    }
+
+} // namespace Quantum
+} // namespace Microsoft
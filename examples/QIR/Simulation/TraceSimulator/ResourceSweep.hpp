@@ -0,0 +1,41 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "TraceSimulator.hpp"
+
+namespace Microsoft
+{
+namespace Quantum
+{
+    // One execution in a resource sweep, such as a QIR entry point called with one of the problem sizes studied.
+    struct ResourceRun
+    {
+        std::string name;
+        std::function<void()> entryPoint;
+    };
+
+    // Resources of each run of a sweep, in the order the runs were given, and all of them merged together.
+    struct ResourceReport
+    {
+        std::vector<ResourceCounts> runs;
+        std::vector<std::string> names;
+        ResourceCounts total;
+
+        void WriteJson(std::ostream& out) const;
+    };
+
+    // Counts the resources of all runs, executing them concurrently on the given number of threads (by default one per
+    // hardware thread). Each run gets its own trace simulator, with its own qubit manager, and its own QIR context.
+    // If any run throws, the first exception is rethrown once all threads have finished.
+    ResourceReport RunResourceSweep(const std::vector<ResourceRun>& runs, unsigned numThreads = 0);
+
+} // namespace Quantum
+} // namespace Microsoft
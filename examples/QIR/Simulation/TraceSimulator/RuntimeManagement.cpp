@@ -1,6 +1,8 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT License.
 
+#include <fstream>
+#include <iostream>
 #include <memory>
 #include <stdexcept>
 
@@ -9,18 +11,46 @@
 using namespace Microsoft::Quantum;
 
 
+TraceSimulator::~TraceSimulator()
+{
+    if (this->counter && this->writeSummary) {
+        if (this->outputFile.empty()) {
+            this->counter->GetCounts().WriteJson(std::cout);
+            std::cout << std::endl;
+        }
+        else {
+            std::ofstream out(this->outputFile);
+            this->counter->GetCounts().WriteJson(out);
+            out << "\n";
+        }
+    }
+    delete this->qbm;
+}
+
+
 ///
 /// Qubit management
 ///
 
 Qubit TraceSimulator::AllocateQubit()
 {
+    if (this->counter)
+        return this->counter->AllocateQubit();
+    this->numLiveQubits++;
     return this->qbm->AllocateQubit();
 }
 
 void TraceSimulator::ReleaseQubit(Qubit q)
 {
+    if (this->counter) {
+        this->counter->ReleaseQubit(q);
+        return;
+    }
     this->qbm->ReleaseQubit(q);
+
+    // The end of a program (or of a top-level operation) is a good time to make sure its trace is complete.
+    if (--this->numLiveQubits == 0 && this->writer)
+        this->writer->Flush();
 }
 
 std::string TraceSimulator::QubitToString(Qubit q)
@@ -33,8 +63,8 @@ std::string TraceSimulator::QubitToString(Qubit q)
 /// Result management
 ///
 
-static Result zero = reinterpret_cast<Result>(0);
-static Result one = reinterpret_cast<Result>(1);
+static const Result zero = reinterpret_cast<Result>(0);
+static const Result one = reinterpret_cast<Result>(1);
 
 void TraceSimulator::ReleaseResult(Result r) {}
 
@@ -68,9 +98,9 @@ namespace Microsoft
 {
 namespace Quantum
 {
-    std::unique_ptr<IRuntimeDriver> CreateTraceSimulator()
+    std::unique_ptr<IRuntimeDriver> CreateTraceSimulator(TraceSimulatorSettings settings)
     {
-        return std::make_unique<TraceSimulator>();
+        return std::make_unique<TraceSimulator>(settings);
     }
 
 } // namespace Quantum
@@ -0,0 +1,44 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+// Converts a binary trace written by the trace simulator back into its text form, e.g.
+//
+//     TraceDecoder trace.bin > trace.txt
+//
+// The decoder doesn't depend on the QIR Runtime, so it can be built on its own.
+
+#include <cstdio>
+#include <iostream>
+
+#include "TraceFormat.hpp"
+
+using namespace Microsoft::Quantum;
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " <binary trace>\n";
+        return 1;
+    }
+    std::FILE* file = std::fopen(argv[1], "rb");
+    if (file == nullptr) {
+        std::cerr << "cannot open " << argv[1] << "\n";
+        return 1;
+    }
+
+    try {
+        TraceReader reader(file);
+        GateRecord record;
+        while (!reader.AtEnd()) {
+            DecodeRecord(reader, record);
+            FormatRecord(std::cout, record);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << argv[1] << ": " << e.what() << "\n";
+        std::fclose(file);
+        return 1;
+    }
+    std::fclose(file);
+    return 0;
+}
@@ -0,0 +1,491 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Microsoft
+{
+namespace Quantum
+{
+    // The binary trace starts with this header, followed by one record per operation. Each record is an opcode byte,
+    // with TraceControlledFlag set if it is followed by the number of controls and their qubit IDs, and then:
+    //
+    // - single-qubit gates: the target qubit ID,
+    // - R: the Pauli axis byte, the angle, and the target qubit ID,
+    // - Exp: the angle, the number of targets, and a Pauli byte and qubit ID for each target,
+    // - Measure: the number of targets, and a Pauli byte and qubit ID for each target.
+    //
+    // Counts and qubit IDs are unsigned LEB128 varints, angles are raw little-endian doubles, and Pauli bytes hold
+    // the value of the PauliId enum (I = 0, X = 1, Z = 2, Y = 3).
+    static constexpr char TraceMagic[8] = {'Q', 'I', 'R', 'T', 'R', 'A', 'C', 'E'};
+    static constexpr uint8_t TraceVersion = 1;
+
+    enum TraceOpcode : uint8_t
+    {
+        TraceOpcode_X = 0,
+        TraceOpcode_Y,
+        TraceOpcode_Z,
+        TraceOpcode_H,
+        TraceOpcode_S,
+        TraceOpcode_AdjointS,
+        TraceOpcode_T,
+        TraceOpcode_AdjointT,
+        TraceOpcode_R,
+        TraceOpcode_Exp,
+        TraceOpcode_Measure,
+        TraceOpcode_Count
+    };
+
+    static constexpr uint8_t TraceControlledFlag = 0x80;
+
+    // Names of the opcodes as printed in the text trace.
+    static constexpr const char* TraceOpcodeNames[TraceOpcode_Count] = {
+        "X", "Y", "Z", "H", "S", "Sdag", "T", "Tdag", "R", "Exp", "Measure"};
+
+    // Names of the Pauli operators, indexed by their PauliId value.
+    static constexpr char TracePauliNames[4] = {'I', 'X', 'Z', 'Y'};
+
+    // One traced operation, as passed from the gate set to the output. The controls are stored first, followed by
+    // the targets, and most operations fit into the inline array. Longer lists continue in the spill buffers, which
+    // keep their capacity when the record is reused, so that recording an operation doesn't allocate memory.
+    struct GateRecord
+    {
+        static constexpr std::size_t inlineQubits = 6;
+        static constexpr std::size_t inlinePaulis = 32;
+
+        TraceOpcode opcode;
+        std::size_t numControls;
+        std::size_t numTargets;
+
+        // Rotation angle of R and Exp.
+        double angle;
+
+        // Pauli operators of the targets of R, Exp and Measure, as 2-bit PauliId values.
+        uint64_t pauliMask;
+
+        // IDs of the controls followed by the targets. Records with more than `inlineQubits` qubits keep all of them
+        // in `spillQubits` instead, so that the IDs are always contiguous.
+        uint64_t qubits[inlineQubits];
+        std::vector<uint64_t> spillQubits;
+        std::vector<uint64_t> spillPaulis;
+
+        void Reset(TraceOpcode opcode, std::size_t numControls, std::size_t numTargets, double angle = 0)
+        {
+            this->opcode = opcode;
+            this->numControls = numControls;
+            this->numTargets = numTargets;
+            this->angle = angle;
+            this->pauliMask = 0;
+            if (numControls + numTargets > inlineQubits)
+                this->spillQubits.resize(numControls + numTargets);
+            if (numTargets > inlinePaulis)
+                this->spillPaulis.assign((numTargets - 1) / inlinePaulis, 0);
+        }
+
+        std::size_t NumQubits() const
+        {
+            return this->numControls + this->numTargets;
+        }
+        uint64_t* QubitIds()
+        {
+            return NumQubits() <= inlineQubits ? this->qubits : this->spillQubits.data();
+        }
+        const uint64_t* QubitIds() const
+        {
+            return NumQubits() <= inlineQubits ? this->qubits : this->spillQubits.data();
+        }
+        uint64_t& QubitId(std::size_t i) { return QubitIds()[i]; }
+        uint64_t QubitId(std::size_t i) const { return QubitIds()[i]; }
+        uint64_t& Control(std::size_t i) { return QubitId(i); }
+        uint64_t Control(std::size_t i) const { return QubitId(i); }
+        uint64_t& Target(std::size_t i) { return QubitId(this->numControls + i); }
+        uint64_t Target(std::size_t i) const { return QubitId(this->numControls + i); }
+
+        void SetPauli(std::size_t target, uint8_t pauli)
+        {
+            uint64_t& word = target < inlinePaulis ? this->pauliMask : this->spillPaulis[target / inlinePaulis - 1];
+            word |= uint64_t(pauli & 3) << (2 * (target % inlinePaulis));
+        }
+        uint8_t Pauli(std::size_t target) const
+        {
+            uint64_t word = target < inlinePaulis ? this->pauliMask : this->spillPaulis[target / inlinePaulis - 1];
+            return (word >> (2 * (target % inlinePaulis))) & 3;
+        }
+    };
+
+    // Encodes trace records into a ring buffer, from which they are written to the file in large chunks.
+    // By default, the buffer is written out by the encoding thread whenever it fills up. With a background writer,
+    // the encoding thread only appends to the buffer and publishes each finished record, while the writer thread
+    // drains it concurrently. Neither side takes a lock: the encoding thread is the only one to move `head` and
+    // the writer thread the only one to move `tail`. If the buffer is full, the encoding thread waits for space.
+    class TraceWriter
+    {
+        std::FILE* file;
+        bool ownsFile;
+        std::vector<uint8_t> buffer;
+        std::size_t mask;
+
+        // Positions only ever increase, and are taken modulo the (power of two) size of the buffer.
+        // Bytes before `tail` have been written to the file, bytes before `head` are ready to be written,
+        // and bytes before `pending` are part of the record being encoded.
+        alignas(64) std::atomic<std::size_t> head{0};
+        alignas(64) std::atomic<std::size_t> tail{0};
+        alignas(64) std::size_t pending = 0;
+        std::size_t knownTail = 0;
+
+        std::thread writerThread;
+        std::atomic<bool> stopping{false};
+
+        // Longest encoding of a single value (a 64-bit varint).
+        static constexpr std::size_t maxValueBytes = 10;
+
+        void Reserve(std::size_t bytes)
+        {
+            if (this->pending + bytes - this->knownTail > this->buffer.size())
+                WaitForSpace(bytes);
+        }
+
+        // Kept out of line so that Reserve, which every Put calls, stays small enough to be inlined into the
+        // encoders.
+        __attribute__((noinline)) void WaitForSpace(std::size_t bytes)
+        {
+            if (!this->writerThread.joinable()) {
+                // The part of the record encoded so far can be written out as well, since the file is just a stream
+                // of bytes.
+                this->head.store(this->pending, std::memory_order_relaxed);
+                WriteOut();
+                this->knownTail = this->pending;
+                return;
+            }
+            EndRecord();
+            while (this->pending + bytes - (this->knownTail = this->tail.load(std::memory_order_acquire)) > this->buffer.size())
+                std::this_thread::yield();
+        }
+
+        // Writes all published bytes to the file.
+        void WriteOut()
+        {
+            std::size_t begin = this->tail.load(std::memory_order_relaxed);
+            std::size_t end = this->head.load(std::memory_order_acquire);
+            if (begin == end)
+                return;
+            std::size_t first = begin & this->mask, last = end & this->mask;
+            if (first < last)
+                std::fwrite(&this->buffer[first], 1, last - first, this->file);
+            else {
+                std::fwrite(&this->buffer[first], 1, this->buffer.size() - first, this->file);
+                std::fwrite(&this->buffer[0], 1, last, this->file);
+            }
+            this->tail.store(end, std::memory_order_release);
+        }
+
+        void RunWriter()
+        {
+            for (unsigned idle = 0;;) {
+                if (this->head.load(std::memory_order_acquire) != this->tail.load(std::memory_order_relaxed)) {
+                    WriteOut();
+                    idle = 0;
+                }
+                else if (this->stopping.load(std::memory_order_acquire)) {
+                    // Everything published before stopping was set has been written.
+                    WriteOut();
+                    return;
+                }
+                else if (++idle < 64)
+                    std::this_thread::yield();
+                else
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+
+      public:
+        // Writes to the given file, or to the standard output if the path is empty. The buffer size is rounded up
+        // to a power of two. With `background`, a separate thread writes the buffer to the file.
+        TraceWriter(const std::string& path, std::size_t bufferBytes, bool background = false)
+        {
+            std::size_t size = 1;
+            while (size < bufferBytes || size < 2*maxValueBytes)
+                size *= 2;
+            this->buffer.resize(size);
+            this->mask = size - 1;
+
+            this->ownsFile = !path.empty();
+            this->file = this->ownsFile ? std::fopen(path.c_str(), "wb") : stdout;
+            if (this->file == nullptr)
+                throw std::runtime_error("cannot create trace file " + path);
+            std::fwrite(TraceMagic, 1, sizeof(TraceMagic), this->file);
+            std::fputc(TraceVersion, this->file);
+
+            if (background)
+                this->writerThread = std::thread(&TraceWriter::RunWriter, this);
+        }
+        ~TraceWriter()
+        {
+            EndRecord();
+            if (this->writerThread.joinable()) {
+                this->stopping.store(true, std::memory_order_release);
+                this->writerThread.join();
+            }
+            else
+                WriteOut();
+            std::fflush(this->file);
+            if (this->ownsFile)
+                std::fclose(this->file);
+        }
+        TraceWriter(const TraceWriter&) = delete;
+        TraceWriter& operator=(const TraceWriter&) = delete;
+
+        void PutByte(uint8_t value)
+        {
+            Reserve(1);
+            this->buffer[this->pending++ & this->mask] = value;
+        }
+
+        void PutVarint(uint64_t value)
+        {
+            Reserve(maxValueBytes);
+            while (value >= 0x80) {
+                this->buffer[this->pending++ & this->mask] = uint8_t(value) | 0x80;
+                value >>= 7;
+            }
+            this->buffer[this->pending++ & this->mask] = uint8_t(value);
+        }
+
+        void PutDouble(double value)
+        {
+            Reserve(sizeof(value));
+            uint8_t bytes[sizeof(value)];
+            std::memcpy(bytes, &value, sizeof(value));
+            for (uint8_t byte : bytes)
+                this->buffer[this->pending++ & this->mask] = byte;
+        }
+
+        // Hands the record encoded since the last call over to the writer thread, if any.
+        void EndRecord()
+        {
+            this->head.store(this->pending, std::memory_order_release);
+        }
+
+        // Waits until all records have been written to the file.
+        void Flush()
+        {
+            EndRecord();
+            if (this->writerThread.joinable()) {
+                while (this->tail.load(std::memory_order_acquire) != this->pending)
+                    std::this_thread::yield();
+            }
+            else
+                WriteOut();
+            this->knownTail = this->pending;
+            std::fflush(this->file);
+        }
+    };
+
+    // Writes the opcode of an operation, followed by its controls if it has any. The ID of control i is given by
+    // controlId(i), so that operations can also be encoded without filling in a GateRecord first.
+    template <typename F>
+    inline void EncodeOpcode(TraceWriter& writer, TraceOpcode opcode, std::size_t numControls, F&& controlId)
+    {
+        if (numControls == 0)
+            writer.PutByte(opcode);
+        else {
+            writer.PutByte(opcode | TraceControlledFlag);
+            writer.PutVarint(numControls);
+            for (std::size_t i = 0; i < numControls; i++)
+                writer.PutVarint(controlId(i));
+        }
+    }
+
+    // Writes the rest of an operation on a single target, i.e. anything but Exp and Measure. The Pauli operator and
+    // angle are only written for R.
+    inline void EncodeSingleTarget(TraceWriter& writer, TraceOpcode opcode, uint8_t pauli, double angle, uint64_t target)
+    {
+        if (opcode == TraceOpcode_R) {
+            writer.PutByte(pauli);
+            writer.PutDouble(angle);
+        }
+        writer.PutVarint(target);
+    }
+
+    // Writes the binary record of an operation.
+    inline void EncodeRecord(TraceWriter& writer, const GateRecord& record)
+    {
+        EncodeOpcode(writer, record.opcode, record.numControls, [&](std::size_t i) { return record.Control(i); });
+
+        switch (record.opcode) {
+            case TraceOpcode_Exp:
+                writer.PutDouble(record.angle);
+                [[fallthrough]];
+            case TraceOpcode_Measure:
+                writer.PutVarint(record.numTargets);
+                for (std::size_t i = 0; i < record.numTargets; i++) {
+                    writer.PutByte(record.Pauli(i));
+                    writer.PutVarint(record.Target(i));
+                }
+                break;
+            default:
+                EncodeSingleTarget(writer, record.opcode, record.Pauli(0), record.angle, record.Target(0));
+        }
+        writer.EndRecord();
+    }
+
+    // Prints an operation in the text form of the trace.
+    inline void FormatRecord(std::ostream& out, const GateRecord& record)
+    {
+        if (record.opcode == TraceOpcode_Measure) {
+            out << "Measuring qubits:\n";
+            for (std::size_t i = 0; i < record.numTargets; i++)
+                out << "    " << record.Target(i) << " in base " << TracePauliNames[record.Pauli(i)] << "\n";
+            return;
+        }
+
+        out << "Applying gate \"";
+        if (record.opcode == TraceOpcode_R)
+            out << "R(" << std::to_string(record.angle) << ")_" << TracePauliNames[record.Pauli(0)];
+        else if (record.opcode == TraceOpcode_Exp) {
+            out << "Exp(" << std::to_string(record.angle) << ",";
+            for (std::size_t i = 0; i < record.numTargets; i++)
+                out << " " << TracePauliNames[record.Pauli(i)];
+            out << ")";
+        }
+        else
+            out << TraceOpcodeNames[record.opcode];
+
+        if (record.opcode == TraceOpcode_Exp) {
+            out << "\" on " << (record.numControls > 0 ? "target " : "") << "qubits ";
+            for (std::size_t i = 0; i < record.numTargets; i++)
+                out << record.Target(i) << " ";
+            if (record.numControls > 0)
+                out << " and controlled on qubits ";
+        }
+        else if (record.numControls > 0)
+            out << "\" on target qubit " << record.Target(0) << " and controlled on qubits ";
+        else
+            out << "\" on qubit " << record.Target(0);
+        for (std::size_t i = 0; i < record.numControls; i++)
+            out << record.Control(i) << " ";
+        out << "\n";
+    }
+
+    // Decodes trace records from a file, reading it in large chunks.
+    class TraceReader
+    {
+        std::FILE* file;
+        std::vector<uint8_t> buffer;
+        std::size_t pos = 0;
+        std::size_t end = 0;
+
+        bool Fill()
+        {
+            if (this->pos < this->end)
+                return true;
+            this->end = std::fread(this->buffer.data(), 1, this->buffer.size(), this->file);
+            this->pos = 0;
+            return this->end > 0;
+        }
+
+      public:
+        // Reads from the given file, which must start with the trace header.
+        TraceReader(std::FILE* file, std::size_t bufferBytes = std::size_t(1) << 20)
+            : file(file)
+            , buffer(bufferBytes)
+        {
+            char magic[sizeof(TraceMagic)];
+            if (std::fread(magic, 1, sizeof(magic), file) != sizeof(magic)
+                || std::memcmp(magic, TraceMagic, sizeof(magic)) != 0 || std::fgetc(file) != TraceVersion)
+                throw std::runtime_error("not a binary trace");
+        }
+
+        // Returns whether the whole trace has been read.
+        bool AtEnd()
+        {
+            return !Fill();
+        }
+
+        uint8_t GetByte()
+        {
+            if (!Fill())
+                throw std::runtime_error("truncated trace");
+            return this->buffer[this->pos++];
+        }
+
+        uint64_t GetVarint()
+        {
+            uint64_t value = 0;
+            for (int shift = 0;; shift += 7) {
+                uint8_t byte = GetByte();
+                value |= uint64_t(byte & 0x7f) << shift;
+                if (!(byte & 0x80))
+                    return value;
+            }
+        }
+
+        double GetDouble()
+        {
+            uint8_t bytes[sizeof(double)];
+            for (uint8_t& byte : bytes)
+                byte = GetByte();
+            double value;
+            std::memcpy(&value, bytes, sizeof(value));
+            return value;
+        }
+    };
+
+    // Reads the binary record of an operation, the inverse of EncodeRecord.
+    inline void DecodeRecord(TraceReader& reader, GateRecord& record)
+    {
+        uint8_t opcode = reader.GetByte();
+        bool controlled = opcode & TraceControlledFlag;
+        opcode &= ~TraceControlledFlag;
+        if (opcode >= TraceOpcode_Count)
+            throw std::runtime_error("unknown opcode " + std::to_string(opcode));
+
+        std::vector<uint64_t> controls(controlled ? reader.GetVarint() : 0);
+        for (uint64_t& control : controls)
+            control = reader.GetVarint();
+
+        auto setControls = [&]() {
+            for (std::size_t i = 0; i < controls.size(); i++)
+                record.Control(i) = controls[i];
+        };
+        switch (opcode) {
+            case TraceOpcode_R: {
+                uint8_t pauli = reader.GetByte();
+                record.Reset(TraceOpcode_R, controls.size(), 1, reader.GetDouble());
+                record.SetPauli(0, pauli);
+                setControls();
+                record.Target(0) = reader.GetVarint();
+                break;
+            }
+            case TraceOpcode_Exp:
+            case TraceOpcode_Measure: {
+                double angle = (opcode == TraceOpcode_Exp) ? reader.GetDouble() : 0;
+                record.Reset(TraceOpcode(opcode), controls.size(), reader.GetVarint(), angle);
+                setControls();
+                for (std::size_t i = 0; i < record.numTargets; i++) {
+                    record.SetPauli(i, reader.GetByte());
+                    record.Target(i) = reader.GetVarint();
+                }
+                break;
+            }
+            default:
+                record.Reset(TraceOpcode(opcode), controls.size(), 1);
+                setControls();
+                record.Target(0) = reader.GetVarint();
+        }
+    }
+
+} // namespace Quantum
+} // namespace Microsoft
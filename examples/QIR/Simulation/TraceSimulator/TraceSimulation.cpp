@@ -2,44 +2,61 @@
 // Licensed under the MIT License.
 
 #include <iostream>
-#include <string>
 
 #include "TraceSimulator.hpp"
 
 using namespace Microsoft::Quantum;
 
-static std::string SelectPauli(PauliId axis)
-{
-    switch (axis) {
-        case PauliId_I:
-            return "I";
-        case PauliId_X:
-            return "X";
-        case PauliId_Y:
-            return "Y";
-        case PauliId_Z:
-            return "Z";
-    }
-}
-
 
 ///
 /// Gate application
 ///
 
-void TraceSimulator::ApplyGate(Gate gate, Qubit target)
+inline void TraceSimulator::Record(TraceOpcode opcode, long numControls, Qubit controls[], long numTargets, Qubit targets[], double angle)
+{
+    this->record.Reset(opcode, numControls, numTargets, angle);
+    uint64_t* ids = this->record.QubitIds();
+    for (long i = 0; i < numControls; i++)
+        ids[i] = QubitManager::GetQubitId(controls[i]);
+    for (long i = 0; i < numTargets; i++)
+        ids[numControls + i] = QubitManager::GetQubitId(targets[i]);
+}
+
+inline void TraceSimulator::Emit()
+{
+    if (this->writer)
+        EncodeRecord(*this->writer, this->record);
+    else {
+        FormatRecord(std::cout, this->record);
+        std::cout << std::flush;
+    }
+}
+
+// Single-target gates make up most of a trace, so they are written to the binary trace straight from the qubits
+// passed to them, with the same encoder functions EncodeRecord uses.
+inline void TraceSimulator::EncodeGate(TraceOpcode opcode, long numControls, Qubit controls[], Qubit target, PauliId axis, double angle)
 {
-    std::cout << "Applying gate \"" << gate << "\" on qubit "
-              << this->qbm->GetQubitName(target) << std::endl;
+    TraceWriter& writer = *this->writer;
+    EncodeOpcode(writer, opcode, numControls, [&](std::size_t i) { return QubitManager::GetQubitId(controls[i]); });
+    EncodeSingleTarget(writer, opcode, axis, angle, QubitManager::GetQubitId(target));
+    writer.EndRecord();
 }
 
-void TraceSimulator::ApplyControlledGate(Gate gate, long numControls, Qubit controls[], Qubit target)
+void TraceSimulator::ApplyGate(TraceOpcode opcode, Qubit target)
 {
-    std::cout << "Applying gate \"" << gate << "\" on target qubit "
-              << this->qbm->GetQubitName(target) << " and controlled on qubits ";
-    for (int i = 0; i < numControls; i++)
-        std::cout << this->qbm->GetQubitName(controls[i]) << " ";
-    std::cout << std::endl;
+    ApplyControlledGate(opcode, 0, nullptr, target);
+}
+
+void TraceSimulator::ApplyControlledGate(TraceOpcode opcode, long numControls, Qubit controls[], Qubit target)
+{
+    if (this->counter)
+        this->counter->Count(opcode, numControls, controls, 1, &target);
+    else if (this->writer)
+        EncodeGate(opcode, numControls, controls, target);
+    else {
+        Record(opcode, numControls, controls, 1, &target);
+        Emit();
+    }
 }
 
 
@@ -49,130 +66,130 @@ void TraceSimulator::ApplyControlledGate(Gate gate, long numControls, Qubit cont
 
 void TraceSimulator::X(Qubit q)
 {
-    ApplyGate("X", q);
+    ApplyGate(TraceOpcode_X, q);
 }
 
 void TraceSimulator::ControlledX(long numControls, Qubit controls[], Qubit target)
 {
-    ApplyControlledGate("X", numControls, controls, target);
+    ApplyControlledGate(TraceOpcode_X, numControls, controls, target);
 }
 
 void TraceSimulator::Y(Qubit q)
 {
-    ApplyGate("Y", q);
+    ApplyGate(TraceOpcode_Y, q);
 }
 
 void TraceSimulator::ControlledY(long numControls, Qubit controls[], Qubit target)
 {
-    ApplyControlledGate("Y", numControls, controls, target);
+    ApplyControlledGate(TraceOpcode_Y, numControls, controls, target);
 }
 
 void TraceSimulator::Z(Qubit q)
 {
-    ApplyGate("Z", q);
+    ApplyGate(TraceOpcode_Z, q);
 }
 
 void TraceSimulator::ControlledZ(long numControls, Qubit controls[], Qubit target)
 {
-    ApplyControlledGate("Z", numControls, controls, target);
+    ApplyControlledGate(TraceOpcode_Z, numControls, controls, target);
 }
 
 void TraceSimulator::H(Qubit q)
 {
-    ApplyGate("H", q);
+    ApplyGate(TraceOpcode_H, q);
 }
 
 void TraceSimulator::ControlledH(long numControls, Qubit controls[], Qubit target)
 {
-    ApplyControlledGate("H", numControls, controls, target);
+    ApplyControlledGate(TraceOpcode_H, numControls, controls, target);
 }
 
 void TraceSimulator::S(Qubit q)
 {
-    ApplyGate("S", q);
+    ApplyGate(TraceOpcode_S, q);
 }
 
 void TraceSimulator::ControlledS(long numControls, Qubit controls[], Qubit target)
 {
-    ApplyControlledGate("S", numControls, controls, target);
+    ApplyControlledGate(TraceOpcode_S, numControls, controls, target);
 }
 
 void TraceSimulator::AdjointS(Qubit q)
 {
-    ApplyGate("Sdag", q);
+    ApplyGate(TraceOpcode_AdjointS, q);
 }
 
 void TraceSimulator::ControlledAdjointS(long numControls, Qubit controls[], Qubit target)
 {
-    ApplyControlledGate("Sdag", numControls, controls, target);
+    ApplyControlledGate(TraceOpcode_AdjointS, numControls, controls, target);
 }
 
 void TraceSimulator::T(Qubit q)
 {
-    ApplyGate("T", q);
+    ApplyGate(TraceOpcode_T, q);
 }
 
 void TraceSimulator::ControlledT(long numControls, Qubit controls[], Qubit target)
 {
-    ApplyControlledGate("T", numControls, controls, target);
+    ApplyControlledGate(TraceOpcode_T, numControls, controls, target);
 }
 
 void TraceSimulator::AdjointT(Qubit q)
 {
-    ApplyGate("Tdag", q);
+    ApplyGate(TraceOpcode_AdjointT, q);
 }
 
 void TraceSimulator::ControlledAdjointT(long numControls, Qubit controls[], Qubit target)
 {
-    ApplyControlledGate("Tdag", numControls, controls, target);
+    ApplyControlledGate(TraceOpcode_AdjointT, numControls, controls, target);
 }
 
 void TraceSimulator::R(PauliId axis, Qubit q, double theta)
 {
-    Gate gatename = "R("+std::to_string(theta)+")_"+SelectPauli(axis);
-    ApplyGate(gatename, q);
+    ControlledR(0, nullptr, axis, q, theta);
 }
 
 void TraceSimulator::ControlledR(long numControls, Qubit controls[], PauliId axis, Qubit target, double theta)
 {
-    Gate gatename = "R("+std::to_string(theta)+")_"+SelectPauli(axis);
-    ApplyControlledGate(gatename, numControls, controls, target);
+    if (this->counter) {
+        this->counter->Count(TraceOpcode_R, numControls, controls, 1, &target);
+        return;
+    }
+    if (this->writer) {
+        EncodeGate(TraceOpcode_R, numControls, controls, target, axis, theta);
+        return;
+    }
+    Record(TraceOpcode_R, numControls, controls, 1, &target, theta);
+    this->record.SetPauli(0, axis);
+    Emit();
 }
 
 void TraceSimulator::Exp(long numTargets, PauliId paulis[], Qubit targets[], double theta)
 {
-    Gate gatename = "Exp(" + std::to_string(theta) + ",";
-    for (int i = 0; i < numTargets; i++)
-        gatename += " " + SelectPauli(paulis[i]);
-    gatename += ")";
-
-    std::cout << "Applying gate \"" << gatename << "\" on qubits ";
-    for (int i = 0; i < numTargets; i++)
-        std::cout << this->qbm->GetQubitName(targets[i]) << " ";
-    std::cout << std::endl;
+    ControlledExp(0, nullptr, numTargets, paulis, targets, theta);
 }
 
 void TraceSimulator::ControlledExp(long numControls, Qubit controls[], long numTargets, PauliId paulis[], Qubit targets[], double theta)
 {
-    Gate gatename = "Exp(" + std::to_string(theta) + ",";
-    for (int i = 0; i < numTargets; i++)
-        gatename += " " + SelectPauli(paulis[i]);
-    gatename += ")";
-
-    std::cout << "Applying gate \"" << gatename << "\" on target qubits ";
-    for (int i = 0; i < numTargets; i++)
-        std::cout << this->qbm->GetQubitName(targets[i]) << " ";
-    std::cout << " and controlled on qubits ";
-    for (int i = 0; i < numControls; i++)
-        std::cout << this->qbm->GetQubitName(controls[i]) << " ";
-    std::cout << std::endl;
+    if (this->counter) {
+        this->counter->Count(TraceOpcode_Exp, numControls, controls, numTargets, targets);
+        return;
+    }
+    Record(TraceOpcode_Exp, numControls, controls, numTargets, targets, theta);
+    for (long i = 0; i < numTargets; i++)
+        this->record.SetPauli(i, paulis[i]);
+    Emit();
 }
 
 Result TraceSimulator::Measure(long numBases, PauliId bases[], long numTargets, Qubit targets[])
 {
-    std::cout << "Measuring qubits:" << std::endl;
-    for (int i = 0; i < numTargets; i++)
-        std::cout << "    " << this->qbm->GetQubitName(targets[i])
-                  << " in base " << SelectPauli(bases[i]) << std::endl;
+    if (this->counter) {
+        this->counter->Count(TraceOpcode_Measure, 0, nullptr, numTargets, targets);
+        return UseZero();
+    }
+    Record(TraceOpcode_Measure, 0, nullptr, numTargets, targets);
+    for (long i = 0; i < numTargets; i++)
+        this->record.SetPauli(i, bases[i]);
+    Emit();
     return UseZero();
 }
@@ -1,34 +1,108 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT License.
 
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
 #include "QirRuntimeApi_I.hpp"
 #include "QSharpSimApi_I.hpp"
 
 #include "QubitManager.hpp"
-
-using Gate = std::string;
+#include "TraceFormat.hpp"
+#include "ResourceCounter.hpp"
 
 namespace Microsoft
 {
 namespace Quantum
 {
+    enum TraceOutput
+    {
+        // One line of text per operation, printed to the standard output.
+        TraceOutput_Text,
+
+        // Compact binary records (see TraceFormat.hpp), which TraceDecoder converts back to text.
+        TraceOutput_Binary,
+
+        // No trace at all, only a JSON summary of the resources used (see ResourceCounter.hpp) on destruction.
+        TraceOutput_Resources
+    };
+
+    struct TraceSimulatorSettings
+    {
+        TraceOutput output = TraceOutput_Text;
+
+        // File to write the binary trace or the resource summary to, or the standard output if empty.
+        std::string outputFile;
+
+        // Size of the ring buffer the binary trace is collected in before it is written (rounded up to a power of two).
+        std::size_t bufferBytes = std::size_t(1) << 22;
+
+        // Whether the binary trace is written to the file by a background thread, so that the program being traced
+        // only ever appends to the buffer, unless it is full. The trace is flushed once the last qubit is released.
+        bool backgroundWriter = false;
+
+        // Whether the resource summary is written on destruction, rather than only read from GetResourceCounts().
+        bool writeSummary = true;
+    };
+
     class TraceSimulator : public IRuntimeDriver, public IQuantumGateSet
     {
         // Associated qubit manager instance to handle qubit representation.
         QubitManager *qbm;
 
+        // Encoder of the binary trace, or null when printing text.
+        std::unique_ptr<TraceWriter> writer;
+
+        // Counter of the resources used, or null when tracing operations. When counting, it also hands out the qubits
+        // in place of the qubit manager, reusing the IDs of released qubits.
+        std::unique_ptr<ResourceCounter> counter;
+        std::string outputFile;
+        bool writeSummary;
+
+        // Number of qubits allocated and not yet released, used to flush the binary trace once none are left. Not
+        // kept when counting resources, since the counter keeps its own.
+        uint64_t numLiveQubits = 0;
+
+        // The operation being traced, reused for every operation so that its spill buffers are only allocated once.
+        GateRecord record;
+
+        // Fill in the record of an operation. The Pauli operators, if any, are set by the caller.
+        void Record(TraceOpcode opcode, long numControls, Qubit controls[], long numTargets, Qubit targets[], double angle = 0);
+
+        // Pass the record on to the binary trace or the text trace. Resources are counted directly from the qubits
+        // passed to each gate instead, without filling in a record.
+        void Emit();
+
+        // Write a gate on a single target to the binary trace without filling in a record.
+        void EncodeGate(TraceOpcode opcode, long numControls, Qubit controls[], Qubit target, PauliId axis = PauliId_I, double angle = 0);
+
         // To be called by quantum gate set operations.
-        void ApplyGate(Gate gate, Qubit target);
-        void ApplyControlledGate(Gate gate, long numControls, Qubit controls[], Qubit target);
+        void ApplyGate(TraceOpcode opcode, Qubit target);
+        void ApplyControlledGate(TraceOpcode opcode, long numControls, Qubit controls[], Qubit target);
 
       public:
-        TraceSimulator()
+        TraceSimulator(TraceSimulatorSettings settings = {})
         {
             this->qbm = new QubitManager();
+            if (settings.output == TraceOutput_Binary)
+                this->writer = std::make_unique<TraceWriter>(settings.outputFile, settings.bufferBytes, settings.backgroundWriter);
+            if (settings.output == TraceOutput_Resources)
+                this->counter = std::make_unique<ResourceCounter>();
+            this->outputFile = settings.outputFile;
+            this->writeSummary = settings.writeSummary;
         }
-        ~TraceSimulator()
+        ~TraceSimulator();
+
+        // Resources used so far. Only available when counting resources.
+        const ResourceCounts& GetResourceCounts() const
         {
-            delete this->qbm;
+            if (!this->counter)
+                throw std::logic_error("operation_not_supported");
+            return this->counter->GetCounts();
         }
 
 
@@ -99,5 +173,7 @@ namespace Quantum
 
     }; // class TraceSimulator
 
+    std::unique_ptr<IRuntimeDriver> CreateTraceSimulator(TraceSimulatorSettings settings = {});
+
 } // namespace Quantum
 } // namespace Microsoft